@@ -0,0 +1,373 @@
+// Replays keystroke traces through VarnamEngine/VarnamState and reports
+// per key latency as JSON.
+//
+// usage: varnamfcitx_bench [--scheme ID] [--repeat N] [--fake]
+//          [--fake-latency-us N] [--fake-candidates N] TRACE...
+//
+// --fake replaces libgovarnam with FakeVarnamBackend so the plugin's own
+// overhead can be measured, or a slow engine simulated.
+//
+// The traces are replayed twice, first with learning off and then with
+// every committed word learned, reported under "learning" together with
+// the time the final write of the learned words took.
+//
+// allocations_per_key counts the calls of every operator new variant made
+// on the main thread while a key is handled. Allocations of the worker
+// threads and plain malloc calls, such as libgovarnam's, are not included.
+
+#include "varnam_engine.h"
+#include "varnam_fake_backend.h"
+#include "varnam_state.h"
+#include "varnam_transliterator.h"
+
+#include <fcitx-config/rawconfig.h>
+#include <fcitx/event.h>
+#include <fcitx/inputcontext.h>
+#include <fcitx/inputcontextmanager.h>
+#include <fcitx/inputmethodentry.h>
+#include <fcitx/instance.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+// only the main thread counts, it is the one handling keys
+uint64_t allocations = 0;
+thread_local bool countAllocations = false;
+
+void *allocate(size_t size, size_t alignment = 0) {
+  if (countAllocations) {
+    ++allocations;
+  }
+  size = size ? size : 1;
+  if (alignment <= alignof(std::max_align_t)) {
+    return std::malloc(size);
+  }
+  // aligned_alloc wants a multiple of the alignment
+  return std::aligned_alloc(alignment,
+                            (size + alignment - 1) / alignment * alignment);
+}
+
+void *allocateOrThrow(size_t size, size_t alignment = 0) {
+  if (void *ptr = allocate(size, alignment)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+} // namespace
+
+void *operator new(size_t size) { return allocateOrThrow(size); }
+
+void *operator new[](size_t size) { return allocateOrThrow(size); }
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+  return allocateOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+  return allocateOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void *operator new(size_t size, std::align_val_t alignment,
+                   const std::nothrow_t &) noexcept {
+  return allocate(size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment,
+                     const std::nothrow_t &) noexcept {
+  return allocate(size, static_cast<size_t>(alignment));
+}
+
+// everything above comes from malloc or aligned_alloc
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+
+namespace fcitx {
+namespace {
+
+// input context that swallows everything the engine sends to the client
+class BenchInputContext : public InputContext {
+public:
+  BenchInputContext(InputContextManager &manager)
+      : InputContext(manager, "varnamfcitx_bench") {
+    created();
+  }
+
+  ~BenchInputContext() { destroy(); }
+
+  const char *frontend() const override { return "bench"; }
+
+  std::string committed;
+
+protected:
+  void commitStringImpl(const std::string &text) override {
+    committed.append(text);
+  }
+  void deleteSurroundingTextImpl(int, unsigned int) override {}
+  void forwardKeyImpl(const ForwardKeyEvent &) override {}
+  void updatePreeditImpl() override {}
+};
+
+std::vector<Key> parseTrace(const std::string &path) {
+  std::vector<Key> keys;
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "cannot open trace: " << path << std::endl;
+    std::exit(1);
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    for (size_t i = 0; i < line.size(); i++) {
+      auto end = line[i] == '<' ? line.find('>', i) : std::string::npos;
+      if (end != std::string::npos) {
+        keys.emplace_back(line.substr(i + 1, end - i - 1));
+        i = end;
+      } else {
+        keys.emplace_back(static_cast<KeySym>(line[i]));
+      }
+    }
+  }
+  return keys;
+}
+
+const char *keyType(const Key &key) {
+  switch (key.sym()) {
+  case FcitxKey_BackSpace:
+  case FcitxKey_Delete:
+    return "delete";
+  case FcitxKey_Left:
+  case FcitxKey_Right:
+  case FcitxKey_Home:
+  case FcitxKey_End:
+    return "cursor";
+  case FcitxKey_Return:
+  case FcitxKey_Escape:
+  case FcitxKey_Tab:
+    return "commit";
+  default:
+    break;
+  }
+  if (key.isDigit()) {
+    return "digit";
+  }
+  if (isWordBreak(key.sym())) {
+    return "commit";
+  }
+  return "char";
+}
+
+double percentile(const std::vector<double> &sorted, double p) {
+  size_t idx = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[idx];
+}
+
+struct Run {
+  std::map<std::string, std::vector<double>> latencies;
+  uint64_t keys = 0;
+  uint64_t allocations = 0;
+  uint64_t transliterations = 0;
+  uint64_t learned = 0;
+  double flushMs = 0;
+};
+
+void printRun(Run &run) {
+  std::cout << "\"keys\":" << run.keys
+            << ",\"transliterations\":" << run.transliterations
+            << ",\"allocations_per_key\":"
+            << (run.keys ? static_cast<double>(run.allocations) / run.keys
+                         : 0)
+            << ",\"latency_us\":{";
+  bool first = true;
+  for (auto &[type, samples] : run.latencies) {
+    std::sort(samples.begin(), samples.end());
+    std::cout << (first ? "" : ",") << "\"" << type << "\":{"
+              << "\"count\":" << samples.size()
+              << ",\"p50\":" << percentile(samples, 0.50)
+              << ",\"p95\":" << percentile(samples, 0.95)
+              << ",\"p99\":" << percentile(samples, 0.99)
+              << ",\"max\":" << samples.back() << "}";
+    first = false;
+  }
+  std::cout << "}";
+}
+
+} // namespace
+} // namespace fcitx
+
+int main(int argc, char *argv[]) {
+  using namespace fcitx;
+  countAllocations = true;
+
+  std::string scheme = "ml";
+  int repeat = 1;
+  bool fake = false;
+  FakeVarnamBackend::Options fakeOptions;
+  std::vector<std::string> traces;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--scheme" && i + 1 < argc) {
+      scheme = argv[++i];
+    } else if (arg == "--repeat" && i + 1 < argc) {
+      repeat = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--fake") {
+      fake = true;
+    } else if (arg == "--fake-latency-us" && i + 1 < argc) {
+      fakeOptions.latency = std::chrono::microseconds(std::atol(argv[++i]));
+    } else if (arg == "--fake-candidates" && i + 1 < argc) {
+      fakeOptions.candidates = std::max(0, std::atoi(argv[++i]));
+    } else {
+      traces.push_back(arg);
+    }
+  }
+  if (traces.empty()) {
+    std::cerr << "usage: " << argv[0]
+              << " [--scheme ID] [--repeat N] [--fake] [--fake-latency-us N]"
+                 " [--fake-candidates N] TRACE..."
+              << std::endl;
+    return 1;
+  }
+  if (fake) {
+    VarnamBackend::set(std::make_unique<FakeVarnamBackend>(fakeOptions));
+  }
+
+  std::vector<Key> keys;
+  for (const auto &trace : traces) {
+    auto traceKeys = parseTrace(trace);
+    keys.insert(keys.end(), traceKeys.begin(), traceKeys.end());
+  }
+
+  // keep configuration, learnings and caches away from the user's profile
+  char dataDir[] = "/tmp/varnamfcitx_bench.XXXXXX";
+  if (!mkdtemp(dataDir)) {
+    std::perror("mkdtemp");
+    return 1;
+  }
+  setenv("XDG_CONFIG_HOME", dataDir, 1);
+  setenv("XDG_DATA_HOME", dataDir, 1);
+
+  {
+    char *instanceArgv[] = {argv[0]};
+    Instance instance(1, instanceArgv);
+    VarnamEngine engine(&instance);
+    BenchInputContext ic(instance.inputContextManager());
+    InputMethodEntry entry(scheme, scheme, "", "varnamfcitx");
+    InputContextSwitchInputMethodEvent activateEvent(
+        InputMethodSwitchedReason::Other, "", &ic);
+
+    // measure the engine round trip on the key path, the second run also
+    // learns every committed word
+    auto run = [&](bool learn) {
+      RawConfig config;
+      config.setValueByPath("AsyncTransliteration", "False");
+      config.setValueByPath("KeyBurstDelay", "0");
+      config.setValueByPath("Learn Words", learn ? "True" : "False");
+      engine.setConfig(config);
+      engine.activate(entry, activateEvent);
+
+      Run result;
+      uint64_t transliterations =
+          VarnamTransliterator::transliterationCount();
+      for (int round = 0; round < repeat; round++) {
+        for (const auto &key : keys) {
+          KeyEvent event(&ic, key);
+          uint64_t allocationsBefore = allocations;
+          auto start = std::chrono::steady_clock::now();
+          engine.keyEvent(entry, event);
+          auto end = std::chrono::steady_clock::now();
+          result.allocations += allocations - allocationsBefore;
+          result.latencies[keyType(key)].push_back(
+              std::chrono::duration<double, std::micro>(end - start).count());
+          ++result.keys;
+        }
+      }
+      result.transliterations =
+          VarnamTransliterator::transliterationCount() - transliterations;
+
+      engine.deactivate(entry, activateEvent);
+      // the words still pending are written off the key path, time them
+      // separately
+      auto start = std::chrono::steady_clock::now();
+      engine.learner()->flush();
+      result.flushMs = std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+      result.learned = engine.learner()->stats().written;
+      return result;
+    };
+
+    auto plain = run(false);
+    auto learning = run(true);
+
+    std::cout << "{\"scheme\":\"" << scheme << "\",\"backend\":\""
+              << (fake ? "fake" : "govarnam") << "\",";
+    printRun(plain);
+    std::cout << ",\"learning\":{";
+    printRun(learning);
+    std::cout << ",\"learned\":" << learning.learned
+              << ",\"flush_ms\":" << learning.flushMs << "}}" << std::endl;
+  }
+
+  std::error_code error;
+  std::filesystem::remove_all(dataDir, error);
+  return 0;
+}
@@ -0,0 +1,271 @@
+#include "varnam_backend.h"
+#include "varnam_executor.h"
+#include "varnam_fake_backend.h"
+#include "varnam_utils.h"
+
+#include <fcitx-utils/stringutils.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <unistd.h>
+
+#include <libgovarnam/c-shared.h>
+
+extern "C" {
+#include <libgovarnam/libgovarnam.h>
+}
+
+namespace fcitx {
+
+namespace {
+
+// the words of a transliteration result and their text are allocated by
+// libgovarnam with malloc, varray_free only frees the array itself
+void freeWord(void *ptr) {
+  auto *word = static_cast<vword *>(ptr);
+  if (word) {
+    free(const_cast<char *>(word->text));
+    free(word);
+  }
+}
+
+// context ids of lookups nobody cancels, kept apart from the positive
+// operations of the transliterator
+std::atomic<int> nextContext{-1};
+
+// symbol table entries and their strings are allocated with malloc too
+void freeSymbol(void *ptr) {
+  auto *symbol = static_cast<Symbol *>(ptr);
+  if (symbol) {
+    free(symbol->Pattern);
+    free(symbol->Value1);
+    free(symbol->Value2);
+    free(symbol->Value3);
+    free(symbol->Tag);
+    free(symbol);
+  }
+}
+
+// VARNAM_SYMBOL_VOWEL of govarnam
+constexpr int SymbolVowel = 1;
+
+std::unique_ptr<VarnamBackend> &backendInstance() {
+  static std::unique_ptr<VarnamBackend> backend;
+  return backend;
+}
+
+} // namespace
+
+VarnamBackend *VarnamBackend::get() {
+  // workers may ask for the backend first, create the default only once
+  static std::once_flag created;
+  std::call_once(created, [] {
+    auto &backend = backendInstance();
+    if (backend) {
+      return;
+    }
+    const char *name = std::getenv("FCITX_VARNAM_BACKEND");
+    if (name && strcmp(name, "fake") == 0) {
+      VARNAM_INFO() << "using fake transliteration backend";
+      backend = std::make_unique<VarnamSerialBackend>(
+          std::make_unique<FakeVarnamBackend>(
+              FakeVarnamBackend::optionsFromEnvironment()));
+    } else {
+      backend = std::make_unique<VarnamSerialBackend>(
+          std::make_unique<GovarnamBackend>());
+    }
+  });
+  return backendInstance().get();
+}
+
+void VarnamBackend::set(std::unique_ptr<VarnamBackend> backend) {
+  backendInstance() =
+      std::make_unique<VarnamSerialBackend>(std::move(backend));
+}
+
+int VarnamBackend::learnUses(int varnamHandle, const std::string &word,
+                             int uses) {
+  int current = 0;
+  int rv = weight(varnamHandle, word, &current);
+  if (rv != VARNAM_SUCCESS) {
+    return rv;
+  }
+  return learn(varnamHandle, word, current + uses);
+}
+
+int GovarnamBackend::init(const std::string &scheme, int *varnamHandle) {
+  return varnam_init_from_id(const_cast<char *>(scheme.c_str()),
+                             varnamHandle);
+}
+
+int GovarnamBackend::close(int varnamHandle) {
+  return varnam_close(varnamHandle);
+}
+
+int GovarnamBackend::transliterate(int varnamHandle, int operation,
+                                   const std::string &input,
+                                   std::vector<std::string> &result) {
+  varray *words = nullptr;
+  int rv = varnam_transliterate(varnamHandle, operation,
+                                const_cast<char *>(input.c_str()), &words);
+  // overwrite the strings already in result to reuse their storage
+  size_t count = 0;
+  if (rv == VARNAM_SUCCESS && words) {
+    int length = varray_length(words);
+    for (int i = 0; i < length; i++) {
+      vword *word = static_cast<vword *>(varray_get(words, i));
+      if (!word || !word->text) {
+        continue;
+      }
+      if (count < result.size()) {
+        result[count].assign(word->text);
+      } else {
+        result.emplace_back(word->text);
+      }
+      ++count;
+    }
+  }
+  result.resize(count);
+  if (words) {
+    varray_free(words, freeWord);
+  }
+  return rv;
+}
+
+int GovarnamBackend::cancel(int operation) { return varnam_cancel(operation); }
+
+int GovarnamBackend::learn(int varnamHandle, const std::string &word,
+                           int weight) {
+  return varnam_learn(varnamHandle, const_cast<char *>(word.c_str()), weight);
+}
+
+int GovarnamBackend::weight(int varnamHandle, const std::string &word,
+                            int *weight) {
+  // suggestions are the learnt words starting with word, with their weight
+  varray *words = nullptr;
+  int rv = varnam_get_suggestions(varnamHandle, nextContext--,
+                                  const_cast<char *>(word.c_str()), &words);
+  *weight = 0;
+  if (rv == VARNAM_SUCCESS && words) {
+    int length = varray_length(words);
+    for (int i = 0; i < length; i++) {
+      vword *suggestion = static_cast<vword *>(varray_get(words, i));
+      if (suggestion && suggestion->text && word == suggestion->text) {
+        *weight = suggestion->confidence;
+        break;
+      }
+    }
+  }
+  if (words) {
+    varray_free(words, freeWord);
+  }
+  return rv;
+}
+
+int GovarnamBackend::unlearn(int varnamHandle, const std::string &word) {
+  return varnam_unlearn(varnamHandle, const_cast<char *>(word.c_str()));
+}
+
+int GovarnamBackend::config(int varnamHandle, int key, int value) {
+  return varnam_config(varnamHandle, key, value);
+}
+
+int GovarnamBackend::symbols(int varnamHandle, const std::string &pattern,
+                             std::vector<VarnamSymbol> &result) {
+  // empty fields of the criteria match anything
+  Symbol criteria;
+  memset(&criteria, 0, sizeof(criteria));
+  criteria.Pattern = const_cast<char *>(pattern.c_str());
+  varray *symbols = nullptr;
+  int rv = varnam_search_symbol_table(varnamHandle, nextContext--, criteria,
+                                      &symbols);
+  result.clear();
+  if (rv == VARNAM_SUCCESS && symbols) {
+    int length = varray_length(symbols);
+    for (int i = 0; i < length; i++) {
+      Symbol *symbol = static_cast<Symbol *>(varray_get(symbols, i));
+      if (!symbol || !symbol->Pattern || pattern != symbol->Pattern) {
+        continue;
+      }
+      result.push_back(VarnamSymbol{symbol->Type == SymbolVowel,
+                                    symbol->Value1 ? symbol->Value1 : "",
+                                    symbol->Value2 ? symbol->Value2 : ""});
+    }
+  }
+  if (symbols) {
+    varray_free(symbols, freeSymbol);
+  }
+  return rv;
+}
+
+std::vector<VarnamSchemeInfo> GovarnamBackend::schemes() {
+  std::vector<VarnamSchemeInfo> schemes;
+  varray *details = varnam_get_all_scheme_details();
+  if (details == nullptr) {
+    return schemes;
+  }
+  for (int i = 0; i < varray_length(details); i++) {
+    SchemeDetails *scheme = static_cast<SchemeDetails *>(varray_get(details, i));
+    if (scheme == nullptr) {
+      continue;
+    }
+    schemes.push_back(VarnamSchemeInfo{scheme->Identifier,
+                                       scheme->DisplayName, scheme->LangCode,
+                                       ""});
+  }
+  return schemes;
+}
+
+std::string GovarnamBackend::version() {
+  char *version = varnam_get_version();
+  if (version == nullptr) {
+    return {};
+  }
+  std::string result(version);
+  free(version);
+  return result;
+}
+
+std::vector<std::string> GovarnamBackend::schemeDirectories() {
+  // the lookup order of govarnam's scheme files
+  std::vector<std::string> directories;
+  if (const char *dir = getenv("VARNAM_VST_DIR")) {
+    directories.emplace_back(dir);
+  }
+  directories.emplace_back("/usr/local/share/varnam/schemes");
+  directories.emplace_back("/usr/share/varnam/schemes");
+  return directories;
+}
+
+std::vector<std::string>
+GovarnamBackend::schemeFiles(const std::string &scheme) {
+  std::vector<std::string> files;
+  // the first scheme file found is the one govarnam loads
+  for (const auto &dir : schemeDirectories()) {
+    auto path = stringutils::concat(dir, "/", scheme, ".vst");
+    if (access(path.c_str(), R_OK) == 0) {
+      files.push_back(std::move(path));
+      break;
+    }
+  }
+  // learnings live in $VARNAM_LEARNINGS_DIR or the XDG data dir
+  std::string learnings;
+  if (const char *dir = getenv("VARNAM_LEARNINGS_DIR")) {
+    learnings = dir;
+  } else if (const char *dir = getenv("XDG_DATA_HOME")) {
+    learnings = stringutils::concat(dir, "/varnam/learnings");
+  } else if (const char *dir = getenv("HOME")) {
+    learnings = stringutils::concat(dir, "/.local/share/varnam/learnings");
+  }
+  if (!learnings.empty()) {
+    auto path = stringutils::concat(learnings, "/", scheme, ".vst.learnings");
+    if (access(path.c_str(), R_OK) == 0) {
+      files.push_back(std::move(path));
+    }
+  }
+  return files;
+}
+
+} // namespace fcitx
@@ -0,0 +1,121 @@
+#ifndef _FCITX5_VARNAM_BACKEND_H_
+#define _FCITX5_VARNAM_BACKEND_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fcitx {
+
+struct VarnamSchemeInfo {
+  std::string identifier;
+  std::string displayName;
+  std::string langCode;
+  std::string icon;
+
+  bool operator==(const VarnamSchemeInfo &other) const {
+    return identifier == other.identifier &&
+           displayName == other.displayName && langCode == other.langCode &&
+           icon == other.icon;
+  }
+};
+
+// entry of the symbol table of a scheme
+struct VarnamSymbol {
+  bool vowel;
+  // what the pattern types on its own
+  std::string value1;
+  // the dependent vowel sign of a vowel, may be empty
+  std::string value2;
+};
+
+// Every call the plugin makes into the transliteration engine. Return codes
+// follow libgovarnam (VARNAM_SUCCESS on success). Implementations must
+// accept calls from multiple threads. The backend returned by get() runs all
+// calls on one handle through a single executor thread, see
+// VarnamSerialBackend.
+class VarnamBackend {
+public:
+  virtual ~VarnamBackend() = default;
+
+  virtual int init(const std::string &scheme, int *varnamHandle) = 0;
+
+  virtual int close(int varnamHandle) = 0;
+
+  // operation identifies the call for cancel()
+  virtual int transliterate(int varnamHandle, int operation,
+                            const std::string &input,
+                            std::vector<std::string> &result) = 0;
+
+  // transliterate for a lookup nobody is waiting for, it runs after the
+  // interactive calls on the handle
+  virtual int transliterateBackground(int varnamHandle, int operation,
+                                      const std::string &input,
+                                      std::vector<std::string> &result) {
+    return transliterate(varnamHandle, operation, input, result);
+  }
+
+  virtual int cancel(int operation) = 0;
+
+  // weight is the absolute weight of the word, 0 counts one more use
+  virtual int learn(int varnamHandle, const std::string &word, int weight) = 0;
+
+  // current weight of word, 0 if it has not been learned
+  virtual int weight(int varnamHandle, const std::string &word,
+                     int *weight) = 0;
+
+  // add uses to the weight of word with a single learn
+  virtual int learnUses(int varnamHandle, const std::string &word, int uses);
+
+  virtual int unlearn(int varnamHandle, const std::string &word) = 0;
+
+  virtual int config(int varnamHandle, int key, int value) = 0;
+
+  // symbols of the scheme of varnamHandle typed by exactly pattern
+  virtual int symbols(int varnamHandle, const std::string &pattern,
+                      std::vector<VarnamSymbol> &result) = 0;
+
+  virtual std::vector<VarnamSchemeInfo> schemes() = 0;
+
+  // version of the engine, part of the key of the scheme list cache
+  virtual std::string version() = 0;
+
+  // directories the engine loads schemes from
+  virtual std::vector<std::string> schemeDirectories() = 0;
+
+  // files the engine reads to transliterate with scheme
+  virtual std::vector<std::string> schemeFiles(const std::string &scheme) = 0;
+
+  // implementation specific statistics, one line per entry
+  virtual std::string summary() { return {}; }
+
+  // backend used by the plugin, libgovarnam unless FCITX_VARNAM_BACKEND=fake
+  static VarnamBackend *get();
+
+  // replace the backend, must be called before the engine is created
+  static void set(std::unique_ptr<VarnamBackend> backend);
+};
+
+// VarnamBackend on top of libgovarnam
+class GovarnamBackend : public VarnamBackend {
+public:
+  int init(const std::string &scheme, int *varnamHandle) override;
+  int close(int varnamHandle) override;
+  int transliterate(int varnamHandle, int operation, const std::string &input,
+                    std::vector<std::string> &result) override;
+  int cancel(int operation) override;
+  int learn(int varnamHandle, const std::string &word, int weight) override;
+  int weight(int varnamHandle, const std::string &word, int *weight) override;
+  int unlearn(int varnamHandle, const std::string &word) override;
+  int config(int varnamHandle, int key, int value) override;
+  int symbols(int varnamHandle, const std::string &pattern,
+              std::vector<VarnamSymbol> &result) override;
+  std::vector<VarnamSchemeInfo> schemes() override;
+  std::string version() override;
+  std::vector<std::string> schemeDirectories() override;
+  std::vector<std::string> schemeFiles(const std::string &scheme) override;
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_BACKEND_H_
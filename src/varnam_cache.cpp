@@ -0,0 +1,115 @@
+#include "varnam_cache.h"
+
+#include <algorithm>
+
+namespace fcitx {
+
+size_t VarnamResultCache::entryBytes(const std::string &input,
+                                     const std::vector<std::string> &result) {
+  // the key is stored twice, once in the list node and once in the index
+  size_t bytes = sizeof(Entry) + 2 * input.capacity();
+  for (const auto &word : result) {
+    bytes += sizeof(std::string) + word.capacity();
+  }
+  return bytes;
+}
+
+const std::vector<std::string> *
+VarnamResultCache::find(const std::string &input) {
+  auto it = m_index.find(input);
+  if (it == m_index.end()) {
+    ++m_misses;
+    return nullptr;
+  }
+  ++m_hits;
+  m_entries.splice(m_entries.begin(), m_entries, it->second);
+  return &it->second->result;
+}
+
+void VarnamResultCache::insert(const std::string &input,
+                               const std::vector<std::string> &result) {
+  if (m_capacity == 0 || result.empty()) {
+    return;
+  }
+  auto it = m_index.find(input);
+  if (it != m_index.end()) {
+    erase(it->second);
+  }
+  size_t bytes = entryBytes(input, result);
+  if (bytes > m_capacity) {
+    return;
+  }
+  m_entries.push_front(Entry{input, result, bytes});
+  m_index.emplace(input, m_entries.begin());
+  m_bytes += bytes;
+  shrink();
+}
+
+void VarnamResultCache::insert(const std::string &input,
+                               const std::vector<std::string> &result,
+                               uint64_t epoch) {
+  if (epoch != m_epoch) {
+    return;
+  }
+  insert(input, result);
+}
+
+void VarnamResultCache::invalidatePrefixes(const std::string &input) {
+  ++m_epoch;
+  for (size_t len = input.size(); len > 0; len--) {
+    auto it = m_index.find(input.substr(0, len));
+    if (it != m_index.end()) {
+      erase(it->second);
+    }
+  }
+}
+
+void VarnamResultCache::removeWord(const std::string &word) {
+  ++m_epoch;
+  for (auto it = m_entries.begin(); it != m_entries.end();) {
+    auto &result = it->result;
+    auto match = std::find(result.begin(), result.end(), word);
+    if (match == result.end()) {
+      ++it;
+      continue;
+    }
+    result.erase(match);
+    if (result.empty()) {
+      auto next = std::next(it);
+      erase(it);
+      it = next;
+      continue;
+    }
+    m_bytes -= it->bytes;
+    it->bytes = entryBytes(it->input, result);
+    m_bytes += it->bytes;
+    ++it;
+  }
+}
+
+void VarnamResultCache::clear() {
+  ++m_epoch;
+  m_index.clear();
+  m_entries.clear();
+  m_bytes = 0;
+}
+
+void VarnamResultCache::setCapacity(size_t bytes) {
+  m_capacity = bytes;
+  shrink();
+}
+
+void VarnamResultCache::erase(EntryList::iterator entry) {
+  m_bytes -= entry->bytes;
+  m_index.erase(entry->input);
+  m_entries.erase(entry);
+}
+
+void VarnamResultCache::shrink() {
+  while (!m_entries.empty() && m_bytes > m_capacity) {
+    erase(std::prev(m_entries.end()));
+    ++m_evictions;
+  }
+}
+
+} // namespace fcitx
@@ -0,0 +1,84 @@
+#ifndef _FCITX5_VARNAM_CACHE_H_
+#define _FCITX5_VARNAM_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fcitx {
+
+// LRU cache of transliteration results keyed by the input buffer. One
+// instance is kept per scheme and only used from the fcitx main thread.
+class VarnamResultCache {
+public:
+  VarnamResultCache() = default;
+
+  // find the cached result for input and mark it as most recently used
+  const std::vector<std::string> *find(const std::string &input);
+
+  // check for input without touching its position or the counters
+  bool contains(const std::string &input) const {
+    return m_index.count(input) > 0;
+  }
+
+  void insert(const std::string &input, const std::vector<std::string> &result);
+
+  // insert a result looked up at epoch, dropped if the cache has been
+  // invalidated since then
+  void insert(const std::string &input, const std::vector<std::string> &result,
+              uint64_t epoch);
+
+  // drop input and every cached prefix of it, their dictionary suggestions
+  // may change after the committed word is learnt
+  void invalidatePrefixes(const std::string &input);
+
+  // remove an unlearnt word from every cached result
+  void removeWord(const std::string &word);
+
+  void clear();
+
+  // bumped by every invalidation, background lookups record it when they
+  // are submitted
+  uint64_t epoch() const { return m_epoch; }
+
+  // memory limit in bytes, 0 disables the cache
+  void setCapacity(size_t bytes);
+
+  size_t size() const { return m_entries.size(); }
+  size_t bytes() const { return m_bytes; }
+  uint64_t hits() const { return m_hits; }
+  uint64_t misses() const { return m_misses; }
+  uint64_t evictions() const { return m_evictions; }
+
+private:
+  struct Entry {
+    std::string input;
+    std::vector<std::string> result;
+    size_t bytes;
+  };
+  using EntryList = std::list<Entry>;
+
+  EntryList m_entries;
+  std::unordered_map<std::string, EntryList::iterator> m_index;
+  size_t m_capacity = 0;
+  size_t m_bytes = 0;
+  uint64_t m_hits = 0;
+  uint64_t m_misses = 0;
+  uint64_t m_evictions = 0;
+  uint64_t m_epoch = 0;
+
+  static size_t entryBytes(const std::string &input,
+                           const std::vector<std::string> &result);
+
+  void erase(EntryList::iterator entry);
+
+  // evict least recently used entries until the cache fits its capacity
+  void shrink();
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_CACHE_H_
@@ -4,10 +4,12 @@
 
 #include <fcitx/candidatelist.h>
 
+#include <stdexcept>
+
 namespace fcitx {
 
-VarnamCandidateWord::VarnamCandidateWord(VarnamEngine *engine, const char *text,
-                                         int index)
+VarnamCandidateWord::VarnamCandidateWord(VarnamEngine *engine,
+                                         std::string text, int index)
     : CandidateWord(Text(std::move(text))), m_engine(engine), m_index(index) {}
 
 void VarnamCandidateWord::select(InputContext *inputContext) const {
@@ -15,35 +17,148 @@ void VarnamCandidateWord::select(InputContext *inputContext) const {
   state->selectCandidate(m_index);
 }
 
-VarnamCandidateList::VarnamCandidateList(VarnamEngine *engine, InputContext *ic)
-    : m_engine(engine), m_ic(ic) {
-  const VarnamEngineConfig *config =
-      static_cast<const VarnamEngineConfig *>(m_engine->getConfig());
-  CandidateLayoutHint layout;
-  if (!config) {
+VarnamCandidateList::VarnamCandidateList(
+    VarnamEngine *engine, InputContext *ic,
+    std::shared_ptr<const VarnamEngineConfig> config)
+    : m_engine(engine), m_ic(ic), m_config(std::move(config)) {
+  if (!m_config) {
     VARNAM_WARN() << "Invalid configuration";
-    layout = CandidateLayoutHint::Vertical;
+    m_layout = CandidateLayoutHint::Vertical;
   } else {
-    layout = config->candidateLayout.value();
+    m_layout = m_config->candidateLayout.value();
   }
   setPageable(this);
-  setLayoutHint(layout);
+  setCursorMovable(this);
+}
+
+void VarnamCandidateList::addEntry(const std::string &text, int index) {
+  m_nextEntries.push_back(Entry{static_cast<uint32_t>(m_nextArena.size()),
+                                static_cast<uint32_t>(text.size()), index});
+  m_nextArena.append(text);
+}
+
+bool VarnamCandidateList::setCandidates(const std::vector<std::string> &results,
+                                        const std::string &preedit) {
+  m_nextArena.clear();
+  m_nextEntries.clear();
+  int count = results.size();
+  char preeditAppended = 0;
+  for (int i = 0; i < count; i++) {
+    if ((m_pageSize == 10) &&
+        ((i + (preeditAppended ? (1 + preeditAppended) : 1)) % 10 == 0)) {
+      // TODO ;}
+      addEntry(preedit, i);
+      ++preeditAppended;
+    }
+    addEntry(results[i], preeditAppended ? i + 1 : i);
+  }
+  if (!preeditAppended) {
+    addEntry(preedit, ++count);
+  }
+  if (m_nextEntries == m_entries && m_nextArena == m_arena) {
+    return false;
+  }
+  // keep both buffers around so their capacity is reused on the next key
+  m_arena.swap(m_nextArena);
+  m_entries.swap(m_nextEntries);
+  m_pagePage = -1;
+  if (m_currentPage >= totalPages()) {
+    m_currentPage = 0;
+  }
+  return true;
+}
+
+void VarnamCandidateList::setSelectionKey(const KeyList &keyList) {
+  m_labels.clear();
+  for (const auto &key : keyList) {
+    m_labels.emplace_back(Key::keySymToUTF8(key.sym()) + ". ");
+  }
+}
+
+void VarnamCandidateList::setGlobalCursorIndex(int index) {
+  if (index >= 0 && index < totalSize()) {
+    m_cursor = index;
+  }
+}
+
+std::string_view VarnamCandidateList::text(int index) const {
+  if (index < 0 || index >= totalSize()) {
+    return {};
+  }
+  const auto &entry = m_entries[index];
+  return std::string_view(m_arena).substr(entry.offset, entry.length);
+}
+
+int VarnamCandidateList::find(std::string_view text) const {
+  for (int i = 0; i < totalSize(); i++) {
+    if (this->text(i) == text) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+const Text &VarnamCandidateList::label(int idx) const {
+  static const Text empty;
+  if (idx < 0 || idx >= static_cast<int>(m_labels.size())) {
+    return empty;
+  }
+  return m_labels[idx];
+}
+
+const CandidateWord &VarnamCandidateList::candidate(int idx) const {
+  if (idx < 0 || idx >= size()) {
+    throw std::invalid_argument("Invalid candidate index");
+  }
+  if (m_pagePage != m_currentPage) {
+    m_pageWords.clear();
+    m_pageWords.resize(size());
+    m_pagePage = m_currentPage;
+  }
+  auto &word = m_pageWords[idx];
+  if (!word) {
+    const auto &entry = m_entries[m_currentPage * m_pageSize + idx];
+    word = std::make_unique<VarnamCandidateWord>(
+        m_engine, m_arena.substr(entry.offset, entry.length), entry.index);
+  }
+  return *word;
+}
+
+int VarnamCandidateList::size() const {
+  return std::max(
+      0, std::min(m_pageSize, totalSize() - m_currentPage * m_pageSize));
+}
+
+int VarnamCandidateList::cursorIndex() const {
+  if (m_cursor / m_pageSize != m_currentPage) {
+    return -1;
+  }
+  return m_cursor % m_pageSize;
+}
+
+int VarnamCandidateList::totalPages() const {
+  return (totalSize() + m_pageSize - 1) / m_pageSize;
+}
+
+void VarnamCandidateList::setPage(int page) {
+  if (page < 0 || page >= totalPages()) {
+    return;
+  }
+  m_currentPage = page;
+  // paging always moves the cursor to the first candidate of the page
+  m_cursor = page * m_pageSize;
 }
 
 void VarnamCandidateList::prev() {
-  CommonCandidateList::prev();
-  if (currentPage() >= 0) {
-    setPage(currentPage());
-    setCursorPositionAfterPaging(CursorPositionAfterPaging::ResetToFirst);
+  if (hasPrev()) {
+    setPage(m_currentPage - 1);
   }
   m_ic->updateUserInterface(UserInterfaceComponent::InputPanel);
 }
 
 void VarnamCandidateList::next() {
-  CommonCandidateList::next();
-  if (currentPage() < totalPages()) {
-    setPage(currentPage());
-    setGlobalCursorIndex(pageSize() * currentPage() - (pageSize() - 1));
+  if (hasNext()) {
+    setPage(m_currentPage + 1);
   }
   m_ic->updateUserInterface(UserInterfaceComponent::InputPanel);
 }
@@ -51,27 +166,25 @@ void VarnamCandidateList::next() {
 bool VarnamCandidateList::usedNextBefore() const { return true; }
 
 void VarnamCandidateList::prevCandidate() {
-  CommonCandidateList::prevCandidate();
-  auto state = m_ic->propertyFor(m_engine->factory());
-  int index = globalCursorIndex();
-  if (index >= pageSize() && (currentPage() > 0)) {
-    setPage(currentPage());
+  if (m_entries.empty()) {
+    return;
   }
-  setGlobalCursorIndex(index);
+  auto state = m_ic->propertyFor(m_engine->factory());
+  m_cursor = (m_cursor + totalSize() - 1) % totalSize();
+  m_currentPage = m_cursor / m_pageSize;
   state->selectCandidate(cursorIndex());
   m_ic->updateUserInterface(UserInterfaceComponent::InputPanel);
 }
 
 void VarnamCandidateList::nextCandidate() {
-  CommonCandidateList::nextCandidate();
-  auto state = m_ic->propertyFor(m_engine->factory());
-  int index = globalCursorIndex();
-  if (index >= pageSize() && (currentPage() < totalPages())) {
-    setPage(currentPage());
+  if (m_entries.empty()) {
+    return;
   }
-  setGlobalCursorIndex(index);
+  auto state = m_ic->propertyFor(m_engine->factory());
+  m_cursor = (m_cursor + 1) % totalSize();
+  m_currentPage = m_cursor / m_pageSize;
   state->selectCandidate(cursorIndex());
   m_ic->updateUserInterface(UserInterfaceComponent::InputPanel);
 }
 
-} // namespace fcitx
\ No newline at end of file
+} // namespace fcitx
@@ -6,6 +6,13 @@
 #include <fcitx/candidatelist.h>
 #include <fcitx/inputcontext.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
 namespace fcitx {
 
 class VarnamCandidateWord : public CandidateWord {
@@ -14,18 +21,91 @@ private:
   int m_index;
 
 public:
-  VarnamCandidateWord(VarnamEngine *engine, const char *text, int index);
+  VarnamCandidateWord(VarnamEngine *engine, std::string text, int index);
 
   void select(InputContext *inputContext) const override;
 };
 
-class VarnamCandidateList : public CommonCandidateList {
+// Candidate list over the transliteration results. The words are kept in a
+// single string arena and CandidateWord objects are only created for the
+// page that is actually displayed.
+class VarnamCandidateList : public CandidateList,
+                            public PageableCandidateList,
+                            public CursorMovableCandidateList {
 private:
+  struct Entry {
+    uint32_t offset;
+    uint32_t length;
+    int index;
+
+    bool operator==(const Entry &other) const {
+      return offset == other.offset && length == other.length &&
+             index == other.index;
+    }
+  };
+
   VarnamEngine *m_engine;
   InputContext *m_ic;
+  std::shared_ptr<const VarnamEngineConfig> m_config;
+  CandidateLayoutHint m_layout;
+  int m_pageSize = 5;
+  int m_currentPage = 0;
+  int m_cursor = 0;
+  std::vector<Text> m_labels;
+  std::string m_arena;
+  std::vector<Entry> m_entries;
+  // scratch space for setCandidates, swapped in when the list changed
+  std::string m_nextArena;
+  std::vector<Entry> m_nextEntries;
+  // words of m_pagePage, created on first access
+  mutable std::vector<std::unique_ptr<VarnamCandidateWord>> m_pageWords;
+  mutable int m_pagePage = -1;
+
+  void addEntry(const std::string &text, int index);
 
 public:
-  VarnamCandidateList(VarnamEngine *engine, InputContext *ic);
+  VarnamCandidateList(VarnamEngine *engine, InputContext *ic,
+                      std::shared_ptr<const VarnamEngineConfig> config);
+
+  // configuration the layout and page size were taken from
+  const VarnamEngineConfig *config() const { return m_config.get(); }
+
+  // Replace the candidates with results and the raw preedit.
+  // Returns true if the list changed.
+  bool setCandidates(const std::vector<std::string> &results,
+                     const std::string &preedit);
+
+  void setSelectionKey(const KeyList &keyList);
+
+  void setPageSize(int size) { m_pageSize = std::max(size, 1); }
+
+  int pageSize() const { return m_pageSize; }
+
+  int totalSize() const { return m_entries.size(); }
+
+  int globalCursorIndex() const { return m_cursor; }
+
+  // text of the candidate at index across all pages
+  std::string_view text(int index) const;
+
+  // index of the first candidate with text across all pages, or -1
+  int find(std::string_view text) const;
+
+  void setGlobalCursorIndex(int index);
+
+  const Text &label(int idx) const override;
+
+  const CandidateWord &candidate(int idx) const override;
+
+  int size() const override;
+
+  int cursorIndex() const override;
+
+  CandidateLayoutHint layoutHint() const override { return m_layout; }
+
+  bool hasPrev() const override { return m_currentPage > 0; }
+
+  bool hasNext() const override { return m_currentPage + 1 < totalPages(); }
 
   void prev() override;
 
@@ -36,7 +116,13 @@ public:
   void nextCandidate() override;
 
   bool usedNextBefore() const override;
+
+  int totalPages() const override;
+
+  int currentPage() const override { return m_currentPage; }
+
+  void setPage(int page) override;
 };
 
 } // namespace fcitx
-#endif
\ No newline at end of file
+#endif
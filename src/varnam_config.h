@@ -32,6 +32,17 @@ FCITX_CONFIGURATION(
     Option<bool> shouldLearnWords{this, "Learn Words", _("Learn New Words"),
                                   true};
 
+    // Learned words are collected and written together this often, 0
+    // writes every word right away
+    Option<int, IntConstrain> learnFlushInterval{
+        this, "LearnFlushInterval", _("Save Learned Words Every (Seconds)"),
+        60, IntConstrain(0, 3600)};
+
+    // Learned words are also written once this many are pending
+    Option<int, IntConstrain> learnFlushWords{
+        this, "LearnFlushWords", _("Save Learned Words After (Words)"), 64,
+        IntConstrain(1, 512)};
+
     // Enable Indic Numbers
     Option<bool> enableIndicNumbers{this, "EnableIndicNumbers", _("Enable Indic Numbers"),
                                     false};
@@ -41,6 +52,73 @@ FCITX_CONFIGURATION(
     Option<bool> enablePunctuation{this, "enablePunctuation", _("Enable Indic Punctuation Marks"),
                                     false};
 
+    // Run transliteration off the main loop
+    Option<bool> asyncTransliteration{this, "AsyncTransliteration",
+                                      _("Transliterate In Background"), true};
+
+    // Memory used for caching suggestions of each scheme
+    Option<int, IntConstrain> resultCacheLimit{
+        this, "ResultCacheLimit", _("Suggestion Cache Size (KB)"), 1024,
+        IntConstrain(0, 16384)};
+
+    // Open the last used scheme in the background at startup
+    Option<bool> prewarmScheme{this, "PrewarmScheme",
+                               _("Load Last Used Scheme On Startup"), true};
+
+    // Close schemes that were not used for this long, 0 keeps them open
+    Option<int, IntConstrain> handleIdleTimeout{
+        this, "HandleIdleTimeout", _("Unload Idle Schemes After (Minutes)"),
+        30, IntConstrain(0, 1440)};
+
+    // Read the files of a freshly loaded scheme and look up a few common
+    // inputs in the background, until the first key
+    Option<bool> warmup{this, "Warmup", _("Warm Up Scheme After Loading"),
+                        true};
+
+    // Also ask the kernel to read ahead the whole scheme files
+    Option<bool> warmupReadahead{this, "WarmupReadahead",
+                                 _("Read Ahead Scheme Files On Warm Up"),
+                                 true};
+
+    // Free the buffers of input contexts not typed in for this long, 0
+    // keeps them
+    Option<int, IntConstrain> contextIdleTimeout{
+        this, "ContextIdleTimeout",
+        _("Free Memory Of Idle Windows After (Minutes)"), 5,
+        IntConstrain(0, 1440)};
+
+    // Keys typed faster than this are transliterated together, and no key
+    // waits longer than this for its suggestions, 0 disables it
+    Option<int, IntConstrain> keyBurstDelay{
+        this, "KeyBurstDelay", _("Combine Fast Key Presses Within (ms)"), 30,
+        IntConstrain(0, 500)};
+
+    // Number of likely next letters looked up while idle, 0 disables it
+    Option<int, IntConstrain> prefetchLimit{
+        this, "PrefetchLimit", _("Prefetch Suggestions For Next Letters"), 0,
+        IntConstrain(0, 26)};
+
+    // Time spent prefetching after each key
+    Option<int, IntConstrain> prefetchBudget{
+        this, "PrefetchBudget", _("Prefetch Time Budget (ms)"), 100,
+        IntConstrain(1, 1000)};
+
+    // Show tokenizer suggestions first and merge dictionary ones in later
+    Option<bool> progressiveCandidates{
+        this, "ProgressiveCandidates",
+        _("Show Dictionary Suggestions As They Arrive"), false};
+
+    // Dictionary suggestions arriving later than this after the key are not
+    // merged into the shown candidates, 0 always merges them
+    Option<int, IntConstrain> latencyBudget{
+        this, "LatencyBudget", _("Dictionary Suggestions Latency Budget (ms)"),
+        150, IntConstrain(0, 5000)};
+
+    // Log a latency summary this often, 0 disables it
+    Option<int, IntConstrain> statsLogInterval{
+        this, "StatsLogInterval", _("Log Latency Summary Every (Minutes)"), 60,
+        IntConstrain(0, 1440)};
+
     // Strictly Follow Schema
     Option<bool> strictlyFollowScheme{
         this, "Strictly Follow Scheme",
@@ -1,66 +1,457 @@
 #include "varnam_engine.h"
+#include "varnam_backend.h"
 #include "varnam_state.h"
 #include "varnam_utils.h"
 
 #include <fcitx-config/iniparser.h>
+#include <fcitx-utils/fs.h>
+#include <fcitx-utils/standardpath.h>
 #include <fcitx/inputpanel.h>
-#include <libgovarnam/c-shared.h>
 
-extern "C" {
-#include <libgovarnam/libgovarnam.h>
-}
+#include <fstream>
+#include <sys/stat.h>
 
 namespace fcitx {
 
+namespace {
+
+constexpr char ConfigFile[] = "conf/varnam.conf";
+
+constexpr char LastSchemeFile[] = "varnam/last-scheme";
+
+// interval between checks for idle handles, in microseconds
+constexpr uint64_t IdleCheckInterval = 60 * 1000000ULL;
+
+int64_t configModifiedTime() {
+  auto path =
+      StandardPath::global().locate(StandardPath::Type::PkgConfig, ConfigFile);
+  struct stat st;
+  if (path.empty() || stat(path.c_str(), &st) != 0) {
+    return 0;
+  }
+  return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+         st.st_mtim.tv_nsec;
+}
+
+std::string loadLastScheme() {
+  std::ifstream file(stringutils::concat(
+      StandardPath::global().userDirectory(StandardPath::Type::PkgData), "/",
+      LastSchemeFile));
+  std::string scheme;
+  std::getline(file, scheme);
+  return scheme;
+}
+
+void saveLastScheme(const std::string &scheme) {
+  StandardPath::global().safeSave(
+      StandardPath::Type::PkgData, LastSchemeFile, [&scheme](int fd) {
+        return fs::safeWrite(fd, scheme.data(), scheme.size()) ==
+               static_cast<ssize_t>(scheme.size());
+      });
+}
+
+// options the handles are configured with, changing one changes what every
+// lookup returns
+bool handleOptionsChanged(const VarnamEngineConfig &previous,
+                          const VarnamEngineConfig &config) {
+  return previous.strictlyFollowScheme.value() !=
+             config.strictlyFollowScheme.value() ||
+         previous.dictionarySuggestionsLimit.value() !=
+             config.dictionarySuggestionsLimit.value() ||
+         previous.patternDictionarySuggestionsLimit.value() !=
+             config.patternDictionarySuggestionsLimit.value() ||
+         previous.tokenizerSuggestionsLimit.value() !=
+             config.tokenizerSuggestionsLimit.value() ||
+         previous.enableIndicNumbers.value() !=
+             config.enableIndicNumbers.value() ||
+         previous.progressiveCandidates.value() !=
+             config.progressiveCandidates.value();
+}
+
+bool isInscript(const std::string &scheme) {
+  return scheme.find(INSCRIPT) != std::string::npos;
+}
+
+} // namespace
+
 VarnamEngine::VarnamEngine(Instance *instance)
-    : m_instance(instance), m_factory([this](InputContext &ic) {
-        return new VarnamState(this, ic);
-      }) {
+    : m_instance(instance), m_configMTime(0),
+      m_factory([this](InputContext &ic) { return new VarnamState(this, ic); }),
+      m_transliterator(std::make_unique<VarnamTransliterator>(instance)),
+      m_backgroundTransliterator(std::make_unique<VarnamTransliterator>(
+          instance, VarnamLane::Background)),
+      m_journal(std::make_unique<VarnamLearnJournal>(instance)),
+      m_learner(std::make_unique<VarnamLearner>(
+          instance, m_journal.get(),
+          [this](std::vector<VarnamLearner::Written> written) {
+            onLearnWritten(std::move(written));
+          })),
+      m_prefetcher(std::make_unique<VarnamPrefetcher>(
+          m_backgroundTransliterator.get())),
+      m_warmup(std::make_unique<VarnamWarmup>(
+          m_backgroundTransliterator.get())),
+      m_handlePool(std::make_unique<VarnamHandlePool>()),
+      m_schemeList(std::make_unique<VarnamSchemeList>(instance)) {
   instance->inputContextManager().registerProperty("varnamState", &m_factory);
+  reloadConfig();
+  m_lastScheme = loadLastScheme();
+  if (config()->prewarmScheme.value()) {
+    m_handlePool->prewarm(m_lastScheme);
+  }
+  // words learned before the previous session ended without writing them
+  m_journal->replay([this](std::vector<VarnamLearnJournal::Entry> entries) {
+    replayJournal(std::move(entries));
+  });
+  m_idleTimer = m_instance->eventLoop().addTimeEvent(
+      CLOCK_MONOTONIC, now(CLOCK_MONOTONIC) + IdleCheckInterval, 0,
+      [this](EventSourceTime *source, uint64_t) {
+        releaseIdleHandles();
+        releaseIdleContexts();
+        source->setNextInterval(IdleCheckInterval);
+        source->setOneShot();
+        return true;
+      });
 }
 
 VarnamEngine::~VarnamEngine() {
   m_factory.unregister();
-  if (m_varnam_handle > 0) {
-    int rv = varnam_close(m_varnam_handle);
-    if (rv != VARNAM_SUCCESS) {
-      VARNAM_WARN() << "Failed to close Varnam instance";
+  m_schemeList.reset();
+  m_idleTimer.reset();
+  m_statsTimer.reset();
+  m_learnTimer.reset();
+  m_prefetcher.reset();
+  m_warmup.reset();
+  m_transliterator.reset();
+  m_backgroundTransliterator.reset();
+  m_learner.reset();
+  m_journal.reset();
+  m_handlePool.reset();
+}
+
+int VarnamEngine::configureHandle(const std::string &scheme) {
+  auto config = this->config();
+  VarnamHandleSettings settings{
+      config->strictlyFollowScheme.value(),
+      config->dictionarySuggestionsLimit.value(),
+      config->patternDictionarySuggestionsLimit.value(),
+      config->tokenizerSuggestionsLimit.value(),
+      config->enableIndicNumbers.value()};
+  if (isInscript(scheme)) {
+    // the key map comes from the scheme alone, learned words must not
+    // change what a key types
+    settings.dictionarySuggestionsLimit = 0;
+    settings.patternDictionarySuggestionsLimit = 0;
+    m_handlePool->configure(scheme, VarnamHandleKind::Full, settings);
+    m_inscript[scheme].build(
+        m_handlePool->handle(scheme, VarnamHandleKind::Full));
+    return 0;
+  }
+  int tokenizerHandle = 0;
+  if (config->progressiveCandidates.value()) {
+    tokenizerHandle = m_handlePool->acquireTokenizer(scheme);
+  }
+  // punctuation and digits come from the tokenizer, which the full handle
+  // of progressive candidates does not use
+  auto buildTables = [&](int varnamHandle) {
+    m_punctuation[scheme].build(
+        varnamHandle, config->enablePunctuation.value(),
+        scheme.find(INSCRIPT) != std::string::npos);
+    m_numbers[scheme].build(varnamHandle,
+                            config->enableIndicNumbers.value());
+  };
+  if (tokenizerHandle <= 0) {
+    m_handlePool->configure(scheme, VarnamHandleKind::Full, settings);
+    buildTables(m_handlePool->handle(scheme, VarnamHandleKind::Full));
+    return 0;
+  }
+  // phase one only asks the tokenizer, phase two only the dictionaries
+  auto tokenizerSettings = settings;
+  tokenizerSettings.dictionarySuggestionsLimit = 0;
+  tokenizerSettings.patternDictionarySuggestionsLimit = 0;
+  settings.tokenizerSuggestionsLimit = 0;
+  m_handlePool->configure(scheme, VarnamHandleKind::Tokenizer,
+                          tokenizerSettings);
+  m_handlePool->configure(scheme, VarnamHandleKind::Full, settings);
+  buildTables(tokenizerHandle);
+  return tokenizerHandle;
+}
+
+void VarnamEngine::updateConfigSnapshot() {
+  auto previous = config();
+  std::atomic_store(&m_configSnapshot,
+                    std::shared_ptr<const VarnamEngineConfig>(
+                        std::make_shared<VarnamEngineConfig>(m_config)));
+  bool handlesChanged = !previous || handleOptionsChanged(*previous, m_config);
+  for (const auto &scheme : m_handlePool->schemes()) {
+    if (handlesChanged) {
+      m_punctuation[scheme].clear();
+      m_numbers[scheme].clear();
+      m_inscript[scheme].clear();
     }
+    // only pushes changed settings, the tables rebuild if their own
+    // options changed
+    configureHandle(scheme);
+  }
+  for (auto &[scheme, cache] : m_resultCaches) {
+    if (handlesChanged) {
+      cache.clear();
+    }
+    cache.setCapacity(m_config.resultCacheLimit.value() * 1024);
+  }
+  if (!previous ||
+      previous->statsLogInterval.value() != m_config.statsLogInterval.value()) {
+    updateStatsTimer();
+  }
+  if (!previous ||
+      previous->learnFlushInterval.value() !=
+          m_config.learnFlushInterval.value() ||
+      previous->learnFlushWords.value() != m_config.learnFlushWords.value()) {
+    updateLearnTimer();
+  }
+}
+
+void VarnamEngine::updateStatsTimer() {
+  uint64_t interval = config()->statsLogInterval.value() * 60 * 1000000ULL;
+  if (interval == 0) {
+    m_statsTimer.reset();
+    return;
   }
+  m_statsTimer = m_instance->eventLoop().addTimeEvent(
+      CLOCK_MONOTONIC, now(CLOCK_MONOTONIC) + interval, 0,
+      [this, interval](EventSourceTime *source, uint64_t) {
+        auto summary = latencySummary();
+        if (!summary.empty()) {
+          VARNAM_INFO() << "latency summary:\n" << summary;
+        }
+        source->setNextInterval(interval);
+        source->setOneShot();
+        return true;
+      });
+}
+
+void VarnamEngine::updateLearnTimer() {
+  auto config = this->config();
+  uint64_t interval = config->learnFlushInterval.value() * 1000000ULL;
+  if (interval == 0) {
+    m_learnTimer.reset();
+    m_learner->setFlushThreshold(1);
+    return;
+  }
+  m_learner->setFlushThreshold(config->learnFlushWords.value());
+  m_learnTimer = m_instance->eventLoop().addTimeEvent(
+      CLOCK_MONOTONIC, now(CLOCK_MONOTONIC) + interval, 0,
+      [this, interval](EventSourceTime *source, uint64_t) {
+        m_learner->write();
+        source->setNextInterval(interval);
+        source->setOneShot();
+        return true;
+      });
+}
+
+void VarnamEngine::onLearnWritten(
+    std::vector<VarnamLearner::Written> written) {
+  // the prefixes were invalidated at commit, but they may have been looked
+  // up again before the learn reached the dictionary
+  for (const auto &request : written) {
+    auto cache = m_resultCaches.find(request.scheme);
+    if (cache == m_resultCaches.end()) {
+      continue;
+    }
+    if (!request.learned) {
+      cache->second.removeWord(request.word);
+      continue;
+    }
+    for (const auto &input : request.inputs) {
+      cache->second.invalidatePrefixes(input);
+    }
+  }
+}
+
+void VarnamEngine::replayJournal(
+    std::vector<VarnamLearnJournal::Entry> entries) {
+  // through the handles of the pool, so the learner stays the only writer
+  std::string scheme;
+  int handle = 0;
+  for (const auto &entry : entries) {
+    if (entry.scheme != scheme) {
+      if (handle > 0) {
+        m_handlePool->release(scheme);
+      }
+      scheme = entry.scheme;
+      handle = m_handlePool->acquire(scheme);
+      if (handle <= 0) {
+        VARNAM_WARN() << "cannot replay learn journal for scheme: " << scheme;
+      }
+    }
+    if (handle > 0) {
+      m_learner->replay(entry, handle);
+    }
+  }
+  if (handle > 0) {
+    m_handlePool->release(scheme);
+  }
+  m_learner->write();
+}
+
+std::string VarnamEngine::latencySummary() {
+  auto summary = m_stats.summary();
+  const auto &prefetch = m_prefetcher->stats();
+  uint64_t lookups = prefetch.hits + prefetch.misses;
+  if (lookups > 0) {
+    summary += stringutils::concat(
+        "prefetch issued=", prefetch.issued, " completed=", prefetch.completed,
+        " hits=", prefetch.hits, " misses=", prefetch.misses,
+        " hit_rate=", prefetch.hits * 100 / lookups, "%\n");
+  }
+  summary += VarnamBackend::get()->summary();
+  size_t contexts = 0;
+  size_t contextBytes = 0;
+  m_instance->inputContextManager().foreach(
+      [this, &contexts, &contextBytes](InputContext *ic) {
+        ++contexts;
+        contextBytes += ic->propertyFor(&m_factory)->memoryBytes();
+        return true;
+      });
+  size_t cacheBytes = 0;
+  for (const auto &[scheme, cache] : m_resultCaches) {
+    cacheBytes += cache.bytes();
+  }
+  summary += stringutils::concat("memory contexts=", contexts,
+                                 " context_bytes=", contextBytes,
+                                 " cache_bytes=", cacheBytes, "\n");
+  return summary;
+}
+
+void VarnamEngine::reloadConfigIfModified() {
+  if (configModifiedTime() != m_configMTime) {
+    reloadConfig();
+  }
+}
+
+void VarnamEngine::releaseIdleHandles() {
+  int timeout = config()->handleIdleTimeout.value();
+  if (timeout <= 0) {
+    return;
+  }
+  auto schemes = m_handlePool->idle(std::chrono::minutes(timeout));
+  if (schemes.empty()) {
+    return;
+  }
+  // nothing may still be using the handles we are about to close, the
+  // other schemes keep working
+  std::vector<int> handles;
+  for (const auto &scheme : schemes) {
+    for (auto kind : {VarnamHandleKind::Full, VarnamHandleKind::Tokenizer}) {
+      if (int handle = m_handlePool->handle(scheme, kind)) {
+        handles.push_back(handle);
+      }
+    }
+  }
+  m_transliterator->drain(handles);
+  m_backgroundTransliterator->drain(handles);
+  m_learner->flush(handles);
+  for (const auto &scheme : schemes) {
+    m_handlePool->close(scheme);
+    m_resultCaches[scheme].clear();
+    m_punctuation[scheme].clear();
+    m_numbers[scheme].clear();
+    m_inscript[scheme].clear();
+    m_activatedSchemes.erase(scheme);
+  }
+}
+
+void VarnamEngine::releaseIdleContexts() {
+  int timeout = config()->contextIdleTimeout.value();
+  if (timeout <= 0) {
+    return;
+  }
+  auto idleSince =
+      std::chrono::steady_clock::now() - std::chrono::minutes(timeout);
+  m_instance->inputContextManager().foreach(
+      [this, idleSince](InputContext *ic) {
+        auto state = ic->propertyFor(&m_factory);
+        if (!ic->hasFocus() && state->lastUsed() < idleSince) {
+          state->releaseBuffers();
+        }
+        return true;
+      });
 }
 
 void VarnamEngine::activate(const InputMethodEntry &entry,
                             InputContextEvent &contextEvent) {
-  FCITX_UNUSED(contextEvent);
-  reloadConfig();
+  reloadConfigIfModified();
 #ifdef DEBUG_MODE
   VARNAM_INFO() << "activate scheme:" << entry.uniqueName();
 #endif
-  char *schemeName = const_cast<char *>(entry.uniqueName().c_str());
-  int rv = varnam_init_from_id(schemeName, &m_varnam_handle);
-  if (rv != VARNAM_SUCCESS) {
+  int varnamHandle = m_handlePool->acquire(entry.uniqueName());
+  if (varnamHandle <= 0) {
     VARNAM_WARN() << "Failed to initialize Varnam";
     throw std::runtime_error("failed to initialize varnam");
   }
+  int tokenizerHandle = configureHandle(entry.uniqueName());
+
+  auto config = this->config();
+  auto &resultCache = m_resultCaches[entry.uniqueName()];
+  resultCache.setCapacity(config->resultCacheLimit.value() * 1024);
+
+  bool inscript = isInscript(entry.uniqueName());
+  auto state = contextEvent.inputContext()->propertyFor(&m_factory);
+  state->setScheme(entry.uniqueName(), varnamHandle, tokenizerHandle,
+                   &resultCache, &m_punctuation[entry.uniqueName()],
+                   &m_numbers[entry.uniqueName()],
+                   inscript ? &m_inscript[entry.uniqueName()] : nullptr,
+                   &m_stats.scheme(entry.uniqueName()), config);
+
+  // InScript never looks anything up after the key map is built
+  if (!inscript && m_activatedSchemes.insert(entry.uniqueName()).second) {
+    // its first word is timed apart, with or without a warm-up
+    state->setSchemeLoaded();
+    if (config->warmup.value()) {
+      // progressive results come from two handles, do not cache them
+      m_warmup->start(entry.uniqueName(), varnamHandle,
+                      tokenizerHandle > 0 ? nullptr : &resultCache,
+                      config->warmupReadahead.value());
+    }
+  }
 
-  varnam_config(m_varnam_handle, VARNAM_CONFIG_SET_DICTIONARY_MATCH_EXACT,
-                m_config.strictlyFollowScheme.value());
-  varnam_config(m_varnam_handle, VARNAM_CONFIG_SET_DICTIONARY_SUGGESTIONS_LIMIT,
-                m_config.dictionarySuggestionsLimit.value());
-  varnam_config(m_varnam_handle,
-                VARNAM_CONFIG_SET_PATTERN_DICTIONARY_SUGGESTIONS_LIMIT,
-                m_config.patternDictionarySuggestionsLimit.value());
-  varnam_config(m_varnam_handle, VARNAM_CONFIG_SET_TOKENIZER_SUGGESTIONS_LIMIT,
-                m_config.tokenizerSuggestionsLimit.value());
-  varnam_config(m_varnam_handle, VARNAM_CONFIG_USE_INDIC_DIGITS,
-                m_config.enableIndicNumbers.value());
+  if (entry.uniqueName() != m_lastScheme) {
+    m_lastScheme = entry.uniqueName();
+    saveLastScheme(m_lastScheme);
+  }
 }
 
 void VarnamEngine::deactivate(const InputMethodEntry &entry,
                               InputContextEvent &event) {
 #ifdef DEBUG_MODE
   VARNAM_INFO() << "deactivate scheme:" << entry.uniqueName();
+  const auto &resultCache = m_resultCaches[entry.uniqueName()];
+  VARNAM_INFO() << "result cache hits:" << resultCache.hits()
+                << "misses:" << resultCache.misses()
+                << "evictions:" << resultCache.evictions()
+                << "bytes:" << resultCache.bytes();
+  VARNAM_INFO() << "live result bytes:"
+                << event.inputContext()->propertyFor(&m_factory)->resultBytes();
+  auto learnStats = m_learner->stats();
+  VARNAM_INFO() << "learn queue depth:" << learnStats.depth
+                << "queued:" << learnStats.queued
+                << "coalesced:" << learnStats.coalesced
+                << "dropped:" << learnStats.dropped
+                << "written:" << learnStats.written
+                << "writes:" << learnStats.writes;
+  const auto &prefetchStats = m_prefetcher->stats();
+  VARNAM_INFO() << "prefetch rounds:" << prefetchStats.rounds
+                << "issued:" << prefetchStats.issued
+                << "completed:" << prefetchStats.completed
+                << "hits:" << prefetchStats.hits
+                << "misses:" << prefetchStats.misses;
+  auto warmupStats = m_warmup->stats();
+  VARNAM_INFO() << "warmup runs:" << warmupStats.runs
+                << "stopped:" << warmupStats.stopped
+                << "completed:" << warmupStats.completed
+                << "bytes:" << warmupStats.bytesRead
+                << "lookups:" << warmupStats.lookups;
 #endif
+  m_prefetcher->stop();
   if (event.type() == EventType::InputContextSwitchInputMethod) {
     auto ic = event.inputContext();
     auto state = ic->propertyFor(&m_factory);
@@ -68,53 +459,50 @@ void VarnamEngine::deactivate(const InputMethodEntry &entry,
     state->updateUI();
   }
   reset(entry, event);
-  if (m_varnam_handle > 0) {
-    varnam_close(m_varnam_handle);
-  }
+  // the handle stays open, the journal covers the words until written
+  m_learner->write();
+  m_handlePool->release(entry.uniqueName());
 }
 
 std::vector<InputMethodEntry> VarnamEngine::listInputMethods() {
   std::vector<InputMethodEntry> entries;
-  varray *varnam_schemes = nullptr;
-  varnam_schemes = varnam_get_all_scheme_details();
-  if (varnam_schemes == nullptr) {
-    return entries;
-  }
 #ifdef DEBUG_MODE
   VARNAM_INFO() << "available schemes:";
 #endif
-  for (int i = 0; i < varray_length(varnam_schemes); i++) {
-    SchemeDetails *scheme =
-        static_cast<SchemeDetails *>(varray_get(varnam_schemes, i));
-    if (scheme == nullptr) {
-      continue;
-    }
-    // skip inscript
-    if (strstr(scheme->Identifier, INSCRIPT)) {
-      continue;
-    }
-    std::string iconName = stringutils::concat("varnam-", scheme->LangCode);
+  for (const auto &scheme : m_schemeList->schemes()) {
     std::string displayName =
-        stringutils::concat("Varnam-", scheme->DisplayName);
+        stringutils::concat("Varnam-", scheme.displayName);
 #ifdef DEBUG_MODE
-    VARNAM_INFO() << scheme->LangCode << ":" << displayName;
+    VARNAM_INFO() << scheme.langCode << ":" << displayName;
 #endif
-    InputMethodEntry entry(scheme->Identifier, displayName, scheme->LangCode,
+    InputMethodEntry entry(scheme.identifier, displayName, scheme.langCode,
                            "varnamfcitx");
-    entry.setConfigurable(true).setIcon(iconName);
+    entry.setConfigurable(true).setIcon(scheme.icon);
     entries.emplace_back(std::move(entry));
   }
   return entries;
 }
 
 void VarnamEngine::keyEvent(const InputMethodEntry &entry, KeyEvent &keyEvent) {
-  FCITX_UNUSED(entry);
   // ignore key release events
   if (keyEvent.isRelease()) {
     return;
   }
   auto ic = keyEvent.inputContext();
   auto state = ic->propertyFor(&m_factory);
+  VarnamStageTimer timer(state->stats(), VarnamStage::KeyDispatch);
+  // the engine is busy again, prefetching would only delay this key
+  m_prefetcher->stop();
+  m_warmup->stop();
+  // pick up configuration changes made while the context was active
+  if (state->setConfig(m_configSnapshot)) {
+    int tokenizerHandle = 0;
+    if (m_configSnapshot->progressiveCandidates.value()) {
+      tokenizerHandle = m_handlePool->handle(entry.uniqueName(),
+                                             VarnamHandleKind::Tokenizer);
+    }
+    state->setTokenizerHandle(tokenizerHandle);
+  }
   state->processKeyEvent(keyEvent);
 }
 
@@ -129,10 +517,16 @@ void VarnamEngine::reset(const InputMethodEntry &entry,
 
 void VarnamEngine::setConfig(const RawConfig &config) {
   m_config.load(config);
-  safeSaveAsIni(m_config, "conf/varnam.conf");
+  safeSaveAsIni(m_config, ConfigFile);
+  m_configMTime = configModifiedTime();
+  updateConfigSnapshot();
 }
 
-void VarnamEngine::reloadConfig() { readAsIni(m_config, "conf/varnam.conf"); }
+void VarnamEngine::reloadConfig() {
+  m_configMTime = configModifiedTime();
+  readAsIni(m_config, ConfigFile);
+  updateConfigSnapshot();
+}
 
 } // namespace fcitx
 
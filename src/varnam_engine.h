@@ -1,14 +1,30 @@
 #ifndef _FCITX5_VARNAM_ENGINE_H_
 #define _FCITX5_VARNAM_ENGINE_H_
 
+#include "varnam_cache.h"
 #include "varnam_utils.h"
 #include "varnam_config.h"
-
+#include "varnam_handle_pool.h"
+#include "varnam_journal.h"
+#include "varnam_inscript.h"
+#include "varnam_learner.h"
+#include "varnam_numbers.h"
+#include "varnam_prefetcher.h"
+#include "varnam_punctuation.h"
+#include "varnam_public.h"
+#include "varnam_scheme_list.h"
+#include "varnam_stats.h"
+#include "varnam_transliterator.h"
+#include "varnam_warmup.h"
+
+#include <fcitx-utils/event.h>
 #include <fcitx/addonfactory.h>
 #include <fcitx/addonmanager.h>
 #include <fcitx/inputmethodengine.h>
 #include <fcitx/instance.h>
 
+#include <unordered_set>
+
 namespace fcitx {
 
 class VarnamState;
@@ -16,11 +32,62 @@ class VarnamState;
 class VarnamEngine : public InputMethodEngineV3 {
 
 private:
-  int m_varnam_handle;
   Instance *m_instance;
   VarnamEngineConfig m_config;
+  // immutable copy of m_config shared with input contexts and workers
+  std::shared_ptr<const VarnamEngineConfig> m_configSnapshot;
+  // modification time of varnam.conf when it was last read
+  int64_t m_configMTime;
   KeyState m_selectionKeyModifer;
   FactoryFor<VarnamState> m_factory;
+  VarnamStats m_stats;
+  std::unique_ptr<VarnamTransliterator> m_transliterator;
+  // lookups nobody waits for, behind the keystrokes on every handle
+  std::unique_ptr<VarnamTransliterator> m_backgroundTransliterator;
+  std::unique_ptr<VarnamLearnJournal> m_journal;
+  std::unique_ptr<VarnamLearner> m_learner;
+  std::unique_ptr<VarnamPrefetcher> m_prefetcher;
+  std::unique_ptr<VarnamWarmup> m_warmup;
+  std::unique_ptr<VarnamHandlePool> m_handlePool;
+  std::unique_ptr<VarnamSchemeList> m_schemeList;
+  std::unordered_map<std::string, VarnamResultCache> m_resultCaches;
+  std::unordered_map<std::string, VarnamPunctuationTable> m_punctuation;
+  std::unordered_map<std::string, VarnamNumberTable> m_numbers;
+  std::unordered_map<std::string, VarnamInscriptTable> m_inscript;
+  // schemes activated since their handles were opened
+  std::unordered_set<std::string> m_activatedSchemes;
+  std::unique_ptr<EventSourceTime> m_idleTimer;
+  std::unique_ptr<EventSourceTime> m_statsTimer;
+  std::unique_ptr<EventSourceTime> m_learnTimer;
+  std::string m_lastScheme;
+
+  // push the current configuration to the handles of scheme, returns the
+  // tokenizer handle used for progressive candidates or 0
+  int configureHandle(const std::string &scheme);
+
+  // publish m_config as the new snapshot
+  void updateConfigSnapshot();
+
+  // reload varnam.conf if it was modified since it was last read
+  void reloadConfigIfModified();
+
+  // (re)arm the periodic latency summary in the log
+  void updateStatsTimer();
+
+  // (re)arm the periodic write of learned words
+  void updateLearnTimer();
+
+  // drop the cached results a written learn or unlearn made stale
+  void onLearnWritten(std::vector<VarnamLearner::Written> written);
+
+  // queue the words the previous session did not write
+  void replayJournal(std::vector<VarnamLearnJournal::Entry> entries);
+
+  // free the buffers of contexts without focus that were not used lately
+  void releaseIdleContexts();
+
+  // close handles of schemes nobody used for a while
+  void releaseIdleHandles();
 
 public:
   VarnamEngine(Instance *instance);
@@ -40,15 +107,33 @@ public:
 
   auto factory() { return &m_factory; }
 
+  Instance *instance() const { return m_instance; }
+
   void setConfig(const RawConfig &) override;
 
   void reloadConfig() override;
 
   const VarnamEngineConfig *getConfig() const override { return &m_config; }
 
+  // current configuration snapshot, safe to keep and use from any thread
+  std::shared_ptr<const VarnamEngineConfig> config() const {
+    return std::atomic_load(&m_configSnapshot);
+  }
+
   const KeyState &getSelectionModifer() const { return m_selectionKeyModifer; }
 
-  int getVarnamHandle() const { return m_varnam_handle; }
+  VarnamTransliterator *transliterator() const {
+    return m_transliterator.get();
+  }
+
+  VarnamLearner *learner() const { return m_learner.get(); }
+
+  VarnamPrefetcher *prefetcher() const { return m_prefetcher.get(); }
+
+  VarnamWarmup *warmup() const { return m_warmup.get(); }
+
+  std::string latencySummary();
+  FCITX_ADDON_EXPORT_FUNCTION(VarnamEngine, latencySummary);
 };
 
 class VarnamEngineFactory : public AddonFactory {
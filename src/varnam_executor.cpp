@@ -0,0 +1,271 @@
+#include "varnam_executor.h"
+
+#include <sstream>
+
+extern "C" {
+#include <libgovarnam/libgovarnam.h>
+}
+
+namespace fcitx {
+
+namespace {
+
+const char *laneName(size_t lane) {
+  return lane == static_cast<size_t>(VarnamLane::Interactive) ? "interactive"
+                                                              : "background";
+}
+
+} // namespace
+
+VarnamExecutor::VarnamExecutor(
+    std::array<VarnamLaneStats, VarnamLaneCount> *stats)
+    : m_stats(stats) {
+  m_thread = std::thread(&VarnamExecutor::run, this);
+}
+
+VarnamExecutor::~VarnamExecutor() { stop(); }
+
+int VarnamExecutor::call(VarnamLane lane, int operation,
+                         std::function<int()> fn) {
+  auto index = static_cast<size_t>(lane);
+  std::future<int> result;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stop) {
+      return VARNAM_ERROR;
+    }
+    auto &queue = m_lanes[index];
+    queue.push_back(Task{operation, std::move(fn), std::promise<int>(),
+                         std::chrono::steady_clock::now()});
+    result = queue.back().result.get_future();
+    auto &stats = (*m_stats)[index];
+    int64_t depth = ++stats.depth;
+    int64_t maxDepth = stats.maxDepth.load(std::memory_order_relaxed);
+    while (depth > maxDepth &&
+           !stats.maxDepth.compare_exchange_weak(maxDepth, depth)) {
+    }
+  }
+  m_cond.notify_one();
+  return result.get();
+}
+
+bool VarnamExecutor::cancel(int operation) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (size_t index = 0; index < VarnamLaneCount; index++) {
+    auto &queue = m_lanes[index];
+    for (auto it = queue.begin(); it != queue.end(); ++it) {
+      if (it->operation == operation) {
+        it->result.set_value(VARNAM_ERROR);
+        queue.erase(it);
+        --(*m_stats)[index].depth;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void VarnamExecutor::stop() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stop) {
+      return;
+    }
+    m_stop = true;
+    for (size_t index = 0; index < VarnamLaneCount; index++) {
+      for (auto &task : m_lanes[index]) {
+        task.result.set_value(VARNAM_ERROR);
+        --(*m_stats)[index].depth;
+      }
+      m_lanes[index].clear();
+    }
+  }
+  m_cond.notify_all();
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+}
+
+void VarnamExecutor::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_cond.wait(lock, [this] {
+      return m_stop || !m_lanes[0].empty() || !m_lanes[1].empty();
+    });
+    if (m_stop) {
+      break;
+    }
+    // lanes are ordered by priority
+    size_t index = m_lanes[0].empty() ? 1 : 0;
+    Task task = std::move(m_lanes[index].front());
+    m_lanes[index].pop_front();
+    auto &stats = (*m_stats)[index];
+    --stats.depth;
+    ++stats.tasks;
+    stats.wait.record(std::chrono::steady_clock::now() - task.queued);
+    lock.unlock();
+
+    task.result.set_value(task.fn());
+
+    lock.lock();
+  }
+}
+
+VarnamSerialBackend::VarnamSerialBackend(
+    std::unique_ptr<VarnamBackend> backend)
+    : m_backend(std::move(backend)) {}
+
+VarnamSerialBackend::~VarnamSerialBackend() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto &[handle, executor] : m_executors) {
+    executor->stop();
+  }
+}
+
+std::shared_ptr<VarnamExecutor>
+VarnamSerialBackend::executor(int varnamHandle) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_executors.find(varnamHandle);
+  if (it == m_executors.end()) {
+    return nullptr;
+  }
+  return it->second;
+}
+
+int VarnamSerialBackend::call(int varnamHandle, VarnamLane lane,
+                              int operation, std::function<int()> fn) {
+  auto executor = this->executor(varnamHandle);
+  if (!executor) {
+    return VARNAM_MISUSE;
+  }
+  return executor->call(lane, operation, std::move(fn));
+}
+
+int VarnamSerialBackend::init(const std::string &scheme, int *varnamHandle) {
+  int rv = m_backend->init(scheme, varnamHandle);
+  if (rv == VARNAM_SUCCESS) {
+    auto executor = std::make_shared<VarnamExecutor>(&m_stats);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_executors[*varnamHandle] = std::move(executor);
+  }
+  return rv;
+}
+
+int VarnamSerialBackend::close(int varnamHandle) {
+  std::shared_ptr<VarnamExecutor> executor;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_executors.find(varnamHandle);
+    if (it != m_executors.end()) {
+      executor = std::move(it->second);
+      m_executors.erase(it);
+    }
+  }
+  if (executor) {
+    executor->stop();
+  }
+  // no other call can reach the handle any more
+  return m_backend->close(varnamHandle);
+}
+
+int VarnamSerialBackend::transliterate(int varnamHandle, int operation,
+                                       const std::string &input,
+                                       std::vector<std::string> &result) {
+  return call(varnamHandle, VarnamLane::Interactive, operation, [&]() {
+    return m_backend->transliterate(varnamHandle, operation, input, result);
+  });
+}
+
+int VarnamSerialBackend::transliterateBackground(
+    int varnamHandle, int operation, const std::string &input,
+    std::vector<std::string> &result) {
+  return call(varnamHandle, VarnamLane::Background, operation, [&]() {
+    return m_backend->transliterate(varnamHandle, operation, input, result);
+  });
+}
+
+int VarnamSerialBackend::cancel(int operation) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &[handle, executor] : m_executors) {
+      if (executor->cancel(operation)) {
+        return VARNAM_SUCCESS;
+      }
+    }
+  }
+  return m_backend->cancel(operation);
+}
+
+int VarnamSerialBackend::learn(int varnamHandle, const std::string &word,
+                               int weight) {
+  return call(varnamHandle, VarnamLane::Background, 0, [&]() {
+    return m_backend->learn(varnamHandle, word, weight);
+  });
+}
+
+int VarnamSerialBackend::weight(int varnamHandle, const std::string &word,
+                                int *weight) {
+  return call(varnamHandle, VarnamLane::Background, 0, [&]() {
+    return m_backend->weight(varnamHandle, word, weight);
+  });
+}
+
+int VarnamSerialBackend::learnUses(int varnamHandle, const std::string &word,
+                                   int uses) {
+  // one task, so no other write lands between the read and the learn
+  return call(varnamHandle, VarnamLane::Background, 0, [&]() {
+    return m_backend->learnUses(varnamHandle, word, uses);
+  });
+}
+
+int VarnamSerialBackend::unlearn(int varnamHandle, const std::string &word) {
+  return call(varnamHandle, VarnamLane::Background, 0, [&]() {
+    return m_backend->unlearn(varnamHandle, word);
+  });
+}
+
+int VarnamSerialBackend::config(int varnamHandle, int key, int value) {
+  return call(varnamHandle, VarnamLane::Interactive, 0, [&]() {
+    return m_backend->config(varnamHandle, key, value);
+  });
+}
+
+int VarnamSerialBackend::symbols(int varnamHandle, const std::string &pattern,
+                                 std::vector<VarnamSymbol> &result) {
+  return call(varnamHandle, VarnamLane::Interactive, 0, [&]() {
+    return m_backend->symbols(varnamHandle, pattern, result);
+  });
+}
+
+std::vector<VarnamSchemeInfo> VarnamSerialBackend::schemes() {
+  return m_backend->schemes();
+}
+
+std::string VarnamSerialBackend::version() { return m_backend->version(); }
+
+std::vector<std::string> VarnamSerialBackend::schemeDirectories() {
+  return m_backend->schemeDirectories();
+}
+
+std::vector<std::string>
+VarnamSerialBackend::schemeFiles(const std::string &scheme) {
+  return m_backend->schemeFiles(scheme);
+}
+
+std::string VarnamSerialBackend::summary() {
+  std::ostringstream out;
+  for (size_t index = 0; index < VarnamLaneCount; index++) {
+    const auto &stats = m_stats[index];
+    if (stats.tasks == 0) {
+      continue;
+    }
+    out << "lane " << laneName(index) << " tasks=" << stats.tasks
+        << " depth=" << stats.depth << " max_depth=" << stats.maxDepth
+        << " wait p50<=" << stats.wait.percentile(0.50) << "us"
+        << " p99<=" << stats.wait.percentile(0.99) << "us"
+        << " max=" << stats.wait.maxMicroseconds() << "us\n";
+  }
+  return out.str();
+}
+
+} // namespace fcitx
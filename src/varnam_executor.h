@@ -0,0 +1,120 @@
+#ifndef _FCITX5_VARNAM_EXECUTOR_H_
+#define _FCITX5_VARNAM_EXECUTOR_H_
+
+#include "varnam_backend.h"
+#include "varnam_stats.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace fcitx {
+
+// Interactive calls (transliteration, configuration) always run before
+// queued background ones (learning).
+enum class VarnamLane { Interactive, Background };
+
+constexpr size_t VarnamLaneCount = 2;
+
+// queue metrics of one lane, summed over every handle
+struct VarnamLaneStats {
+  std::atomic<int64_t> depth{0};
+  std::atomic<int64_t> maxDepth{0};
+  std::atomic<uint64_t> tasks{0};
+  // time between queueing a call and the start of its execution
+  VarnamLatencyHistogram wait;
+};
+
+// Single thread owning one engine handle. Every call on the handle runs
+// on this thread, one at a time, interactive lane first.
+class VarnamExecutor {
+public:
+  VarnamExecutor(std::array<VarnamLaneStats, VarnamLaneCount> *stats);
+
+  ~VarnamExecutor();
+
+  // run fn on the executor thread and wait for its result. operation
+  // identifies the call for cancel(), 0 if it cannot be cancelled.
+  int call(VarnamLane lane, int operation, std::function<int()> fn);
+
+  // fail the queued call of operation, false if it is not queued
+  bool cancel(int operation);
+
+  // fail everything still queued and stop the thread
+  void stop();
+
+private:
+  struct Task {
+    int operation;
+    std::function<int()> fn;
+    std::promise<int> result;
+    std::chrono::steady_clock::time_point queued;
+  };
+
+  std::array<VarnamLaneStats, VarnamLaneCount> *m_stats;
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::array<std::deque<Task>, VarnamLaneCount> m_lanes;
+  bool m_stop = false;
+  std::thread m_thread;
+
+  // worker thread main loop
+  void run();
+};
+
+// VarnamBackend wrapper routing every call on a handle through the
+// executor of that handle, so the engine never sees concurrent calls on
+// one handle. cancel() is the only call that bypasses the executor, it has
+// to reach the engine while the call it aborts is running.
+class VarnamSerialBackend : public VarnamBackend {
+public:
+  VarnamSerialBackend(std::unique_ptr<VarnamBackend> backend);
+
+  ~VarnamSerialBackend();
+
+  int init(const std::string &scheme, int *varnamHandle) override;
+  int close(int varnamHandle) override;
+  int transliterate(int varnamHandle, int operation, const std::string &input,
+                    std::vector<std::string> &result) override;
+  int transliterateBackground(int varnamHandle, int operation,
+                              const std::string &input,
+                              std::vector<std::string> &result) override;
+  int cancel(int operation) override;
+  int learn(int varnamHandle, const std::string &word, int weight) override;
+  int weight(int varnamHandle, const std::string &word, int *weight) override;
+  int learnUses(int varnamHandle, const std::string &word, int uses) override;
+  int unlearn(int varnamHandle, const std::string &word) override;
+  int config(int varnamHandle, int key, int value) override;
+  int symbols(int varnamHandle, const std::string &pattern,
+              std::vector<VarnamSymbol> &result) override;
+  std::vector<VarnamSchemeInfo> schemes() override;
+  std::string version() override;
+  std::vector<std::string> schemeDirectories() override;
+  std::vector<std::string> schemeFiles(const std::string &scheme) override;
+  std::string summary() override;
+
+private:
+  std::unique_ptr<VarnamBackend> m_backend;
+  std::array<VarnamLaneStats, VarnamLaneCount> m_stats;
+  std::mutex m_mutex;
+  std::unordered_map<int, std::shared_ptr<VarnamExecutor>> m_executors;
+
+  std::shared_ptr<VarnamExecutor> executor(int varnamHandle);
+
+  int call(int varnamHandle, VarnamLane lane, int operation,
+           std::function<int()> fn);
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_EXECUTOR_H_
@@ -0,0 +1,170 @@
+#include "varnam_fake_backend.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
+extern "C" {
+#include <libgovarnam/libgovarnam.h>
+}
+
+namespace fcitx {
+
+FakeVarnamBackend::Options FakeVarnamBackend::optionsFromEnvironment() {
+  Options options;
+  if (const char *latency = std::getenv("FCITX_VARNAM_FAKE_LATENCY_US")) {
+    options.latency = std::chrono::microseconds(std::atol(latency));
+  }
+  if (const char *candidates = std::getenv("FCITX_VARNAM_FAKE_CANDIDATES")) {
+    options.candidates = std::max(0, std::atoi(candidates));
+  }
+  return options;
+}
+
+FakeVarnamBackend::FakeVarnamBackend(Options options) : m_options(options) {}
+
+int FakeVarnamBackend::init(const std::string &scheme, int *varnamHandle) {
+  if (scheme.empty()) {
+    return VARNAM_ERROR;
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  *varnamHandle = m_nextHandle++;
+  m_handles.insert(*varnamHandle);
+  return VARNAM_SUCCESS;
+}
+
+int FakeVarnamBackend::close(int varnamHandle) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_learnt.erase(varnamHandle);
+  return m_handles.erase(varnamHandle) ? VARNAM_SUCCESS : VARNAM_MISUSE;
+}
+
+bool FakeVarnamBackend::simulateLatency(int operation) {
+  constexpr auto slice = std::chrono::microseconds(500);
+  auto deadline = std::chrono::steady_clock::now() + m_options.latency;
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_cancelled.count(operation)) {
+        return false;
+      }
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      return true;
+    }
+    std::this_thread::sleep_for(
+        std::min<std::chrono::steady_clock::duration>(slice, deadline - now));
+  }
+}
+
+int FakeVarnamBackend::transliterate(int varnamHandle, int operation,
+                                     const std::string &input,
+                                     std::vector<std::string> &result) {
+  result.clear();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_inflight.insert(operation);
+  }
+  bool completed = simulateLatency(operation);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  // a cancel that arrived too late to stop this call must not outlive it
+  m_inflight.erase(operation);
+  m_cancelled.erase(operation);
+  if (!completed) {
+    return VARNAM_ERROR;
+  }
+  if (!m_handles.count(varnamHandle)) {
+    return VARNAM_MISUSE;
+  }
+  // learnt words completing the input, heaviest first
+  std::vector<std::pair<int, std::string>> learnt;
+  for (const auto &[word, weight] : m_learnt[varnamHandle]) {
+    if (word.compare(0, input.size(), input) == 0) {
+      learnt.emplace_back(-weight, word);
+    }
+  }
+  std::sort(learnt.begin(), learnt.end());
+  for (const auto &[weight, word] : learnt) {
+    if (static_cast<int>(result.size()) >= m_options.candidates) {
+      break;
+    }
+    result.push_back(word);
+  }
+  for (int i = 0; static_cast<int>(result.size()) < m_options.candidates;
+       i++) {
+    result.push_back(input + "~" + std::to_string(i));
+  }
+  return VARNAM_SUCCESS;
+}
+
+int FakeVarnamBackend::cancel(int operation) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  // ignore calls that are not running, a late cancel must not hit a
+  // later call reusing the id
+  if (!m_inflight.count(operation)) {
+    return VARNAM_MISUSE;
+  }
+  m_cancelled.insert(operation);
+  return VARNAM_SUCCESS;
+}
+
+int FakeVarnamBackend::learn(int varnamHandle, const std::string &word,
+                             int weight) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_handles.count(varnamHandle)) {
+    return VARNAM_MISUSE;
+  }
+  // like govarnam the weight is absolute, 0 counts one more use
+  auto &learnt = m_learnt[varnamHandle][word];
+  learnt = weight > 0 ? weight : learnt + 1;
+  return VARNAM_SUCCESS;
+}
+
+int FakeVarnamBackend::weight(int varnamHandle, const std::string &word,
+                              int *weight) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_handles.count(varnamHandle)) {
+    return VARNAM_MISUSE;
+  }
+  const auto &learnt = m_learnt[varnamHandle];
+  auto it = learnt.find(word);
+  *weight = it == learnt.end() ? 0 : it->second;
+  return VARNAM_SUCCESS;
+}
+
+int FakeVarnamBackend::unlearn(int varnamHandle, const std::string &word) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_handles.count(varnamHandle)) {
+    return VARNAM_MISUSE;
+  }
+  m_learnt[varnamHandle].erase(word);
+  return VARNAM_SUCCESS;
+}
+
+int FakeVarnamBackend::config(int varnamHandle, int, int) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_handles.count(varnamHandle) ? VARNAM_SUCCESS : VARNAM_MISUSE;
+}
+
+int FakeVarnamBackend::symbols(int varnamHandle, const std::string &,
+                               std::vector<VarnamSymbol> &result) {
+  // no symbol table, callers fall back to transliterating
+  std::lock_guard<std::mutex> lock(m_mutex);
+  result.clear();
+  return m_handles.count(varnamHandle) ? VARNAM_SUCCESS : VARNAM_MISUSE;
+}
+
+std::vector<VarnamSchemeInfo> FakeVarnamBackend::schemes() {
+  return {{"ml", "Malayalam", "ml", ""}, {"hi", "Hindi", "hi", ""}};
+}
+
+std::string FakeVarnamBackend::version() { return "fake"; }
+
+std::vector<std::string> FakeVarnamBackend::schemeDirectories() { return {}; }
+
+std::vector<std::string> FakeVarnamBackend::schemeFiles(const std::string &) {
+  return {};
+}
+
+} // namespace fcitx
@@ -0,0 +1,66 @@
+#ifndef _FCITX5_VARNAM_FAKE_BACKEND_H_
+#define _FCITX5_VARNAM_FAKE_BACKEND_H_
+
+#include "varnam_backend.h"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace fcitx {
+
+// Deterministic in-process stand-in for libgovarnam. Candidates are derived
+// from the input, learnt words starting with the input are ranked first, and
+// every transliteration takes a fixed, cancellable amount of time. Used by
+// the benchmark (--fake) to measure the plugin without the engine, and with
+// FCITX_VARNAM_BACKEND=fake to try a slow engine by hand.
+class FakeVarnamBackend : public VarnamBackend {
+public:
+  struct Options {
+    std::chrono::microseconds latency{0};
+    int candidates = 10;
+  };
+
+  // read FCITX_VARNAM_FAKE_LATENCY_US and FCITX_VARNAM_FAKE_CANDIDATES
+  static Options optionsFromEnvironment();
+
+  explicit FakeVarnamBackend(Options options);
+
+  int init(const std::string &scheme, int *varnamHandle) override;
+  int close(int varnamHandle) override;
+  int transliterate(int varnamHandle, int operation, const std::string &input,
+                    std::vector<std::string> &result) override;
+  int cancel(int operation) override;
+  int learn(int varnamHandle, const std::string &word, int weight) override;
+  int weight(int varnamHandle, const std::string &word, int *weight) override;
+  int unlearn(int varnamHandle, const std::string &word) override;
+  int config(int varnamHandle, int key, int value) override;
+  int symbols(int varnamHandle, const std::string &pattern,
+              std::vector<VarnamSymbol> &result) override;
+  std::vector<VarnamSchemeInfo> schemes() override;
+  std::string version() override;
+  std::vector<std::string> schemeDirectories() override;
+  std::vector<std::string> schemeFiles(const std::string &scheme) override;
+
+private:
+  const Options m_options;
+
+  std::mutex m_mutex;
+  int m_nextHandle = 1;
+  std::set<int> m_handles;
+  // transliterations running, and those of them cancelled
+  std::set<int> m_inflight;
+  std::set<int> m_cancelled;
+  // learnt word weights per handle
+  std::map<int, std::map<std::string, int>> m_learnt;
+
+  // sleep for the configured latency, false if operation got cancelled
+  bool simulateLatency(int operation);
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_FAKE_BACKEND_H_
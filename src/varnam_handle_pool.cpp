@@ -0,0 +1,206 @@
+#include "varnam_handle_pool.h"
+#include "varnam_backend.h"
+#include "varnam_utils.h"
+
+extern "C" {
+#include <libgovarnam/libgovarnam.h>
+}
+
+namespace fcitx {
+
+VarnamHandlePool::~VarnamHandlePool() {
+  waitPrewarm();
+  for (auto &[scheme, entry] : m_entries) {
+    close(scheme, entry.full);
+    close(scheme, entry.tokenizer);
+  }
+}
+
+int VarnamHandlePool::open(const std::string &scheme) {
+  int handle = 0;
+  int rv = VarnamBackend::get()->init(scheme, &handle);
+  if (rv != VARNAM_SUCCESS) {
+    VARNAM_WARN() << "Failed to initialize Varnam scheme:" << scheme;
+    return 0;
+  }
+  return handle;
+}
+
+void VarnamHandlePool::close(const std::string &scheme, Handle &handle) {
+  if (handle.handle <= 0) {
+    return;
+  }
+  int rv = VarnamBackend::get()->close(handle.handle);
+  if (rv != VARNAM_SUCCESS) {
+    VARNAM_WARN() << "Failed to close Varnam instance:" << scheme;
+  }
+  handle.handle = 0;
+}
+
+void VarnamHandlePool::waitPrewarm() {
+  if (!m_prewarmThread.joinable()) {
+    return;
+  }
+  m_prewarmThread.join();
+  if (m_prewarmHandle > 0) {
+    Entry entry;
+    entry.full.handle = m_prewarmHandle;
+    entry.lastUsed = std::chrono::steady_clock::now();
+    m_entries.emplace(m_prewarmScheme, entry);
+  }
+  m_prewarmHandle = 0;
+}
+
+int VarnamHandlePool::acquire(const std::string &scheme) {
+  waitPrewarm();
+  auto it = m_entries.find(scheme);
+  if (it == m_entries.end()) {
+#ifdef DEBUG_MODE
+    VARNAM_INFO() << "open scheme:" << scheme;
+#endif
+    int handle = open(scheme);
+    if (handle <= 0) {
+      return 0;
+    }
+    it = m_entries.emplace(scheme, Entry{}).first;
+    it->second.full.handle = handle;
+  }
+  ++it->second.users;
+  it->second.lastUsed = std::chrono::steady_clock::now();
+  return it->second.full.handle;
+}
+
+int VarnamHandlePool::acquireTokenizer(const std::string &scheme) {
+  waitPrewarm();
+  auto it = m_entries.find(scheme);
+  if (it == m_entries.end()) {
+    return 0;
+  }
+  auto &tokenizer = it->second.tokenizer;
+  if (tokenizer.handle <= 0) {
+#ifdef DEBUG_MODE
+    VARNAM_INFO() << "open tokenizer handle:" << scheme;
+#endif
+    tokenizer.handle = open(scheme);
+  }
+  return tokenizer.handle;
+}
+
+int VarnamHandlePool::handle(const std::string &scheme,
+                             VarnamHandleKind kind) const {
+  auto it = m_entries.find(scheme);
+  if (it == m_entries.end()) {
+    return 0;
+  }
+  return kind == VarnamHandleKind::Full ? it->second.full.handle
+                                        : it->second.tokenizer.handle;
+}
+
+void VarnamHandlePool::release(const std::string &scheme) {
+  auto it = m_entries.find(scheme);
+  if (it == m_entries.end()) {
+    return;
+  }
+  if (it->second.users > 0) {
+    --it->second.users;
+  }
+  it->second.lastUsed = std::chrono::steady_clock::now();
+}
+
+void VarnamHandlePool::prewarm(const std::string &scheme) {
+  waitPrewarm();
+  if (scheme.empty() || m_entries.count(scheme)) {
+    return;
+  }
+  m_prewarmScheme = scheme;
+  m_prewarmThread =
+      std::thread([this, scheme]() { m_prewarmHandle = open(scheme); });
+}
+
+std::vector<std::string> VarnamHandlePool::idle(std::chrono::seconds timeout) {
+  waitPrewarm();
+  std::vector<std::string> schemes;
+  auto now = std::chrono::steady_clock::now();
+  for (const auto &[scheme, entry] : m_entries) {
+    if (entry.users == 0 && now - entry.lastUsed >= timeout) {
+      schemes.push_back(scheme);
+    }
+  }
+  return schemes;
+}
+
+void VarnamHandlePool::close(const std::string &scheme) {
+  waitPrewarm();
+  auto it = m_entries.find(scheme);
+  if (it == m_entries.end()) {
+    return;
+  }
+#ifdef DEBUG_MODE
+  VARNAM_INFO() << "close idle scheme:" << scheme;
+#endif
+  close(scheme, it->second.full);
+  close(scheme, it->second.tokenizer);
+  m_entries.erase(it);
+}
+
+void VarnamHandlePool::configure(const std::string &scheme,
+                                 VarnamHandleKind kind,
+                                 const VarnamHandleSettings &settings) {
+  waitPrewarm();
+  auto it = m_entries.find(scheme);
+  if (it == m_entries.end()) {
+    return;
+  }
+  configure(kind == VarnamHandleKind::Full ? it->second.full
+                                           : it->second.tokenizer,
+            settings);
+}
+
+void VarnamHandlePool::configure(Handle &handle,
+                                 const VarnamHandleSettings &settings) {
+  if (handle.handle <= 0) {
+    return;
+  }
+  auto backend = VarnamBackend::get();
+  bool all = !handle.configured;
+  const auto &old = handle.settings;
+  if (all || old.strictlyFollowScheme != settings.strictlyFollowScheme) {
+    backend->config(handle.handle, VARNAM_CONFIG_SET_DICTIONARY_MATCH_EXACT,
+                    settings.strictlyFollowScheme);
+  }
+  if (all ||
+      old.dictionarySuggestionsLimit != settings.dictionarySuggestionsLimit) {
+    backend->config(handle.handle,
+                    VARNAM_CONFIG_SET_DICTIONARY_SUGGESTIONS_LIMIT,
+                    settings.dictionarySuggestionsLimit);
+  }
+  if (all || old.patternDictionarySuggestionsLimit !=
+                 settings.patternDictionarySuggestionsLimit) {
+    backend->config(handle.handle,
+                    VARNAM_CONFIG_SET_PATTERN_DICTIONARY_SUGGESTIONS_LIMIT,
+                    settings.patternDictionarySuggestionsLimit);
+  }
+  if (all ||
+      old.tokenizerSuggestionsLimit != settings.tokenizerSuggestionsLimit) {
+    backend->config(handle.handle,
+                    VARNAM_CONFIG_SET_TOKENIZER_SUGGESTIONS_LIMIT,
+                    settings.tokenizerSuggestionsLimit);
+  }
+  if (all || old.indicDigits != settings.indicDigits) {
+    backend->config(handle.handle, VARNAM_CONFIG_USE_INDIC_DIGITS,
+                    settings.indicDigits);
+  }
+  handle.configured = true;
+  handle.settings = settings;
+}
+
+std::vector<std::string> VarnamHandlePool::schemes() {
+  waitPrewarm();
+  std::vector<std::string> schemes;
+  for (const auto &[scheme, entry] : m_entries) {
+    schemes.push_back(scheme);
+  }
+  return schemes;
+}
+
+} // namespace fcitx
@@ -0,0 +1,93 @@
+#ifndef _FCITX5_VARNAM_HANDLE_POOL_H_
+#define _FCITX5_VARNAM_HANDLE_POOL_H_
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fcitx {
+
+// govarnam options pushed to a handle through varnam_config
+struct VarnamHandleSettings {
+  bool strictlyFollowScheme;
+  int dictionarySuggestionsLimit;
+  int patternDictionarySuggestionsLimit;
+  int tokenizerSuggestionsLimit;
+  bool indicDigits;
+};
+
+// Progressive candidates use a second handle per scheme that only asks the
+// tokenizer, while the full handle only asks the dictionaries.
+enum class VarnamHandleKind { Full, Tokenizer };
+
+// govarnam handles keyed by scheme identifier. Handles are opened on first
+// use and kept across activations until they have been idle for a while.
+// Only used from the fcitx main thread.
+class VarnamHandlePool {
+public:
+  VarnamHandlePool() = default;
+
+  ~VarnamHandlePool();
+
+  // get the handle of scheme, opening it if needed, returns 0 on failure
+  int acquire(const std::string &scheme);
+
+  // get the tokenizer handle of an acquired scheme, opening it if needed,
+  // returns 0 on failure
+  int acquireTokenizer(const std::string &scheme);
+
+  // handle of scheme if it is open, 0 otherwise
+  int handle(const std::string &scheme, VarnamHandleKind kind) const;
+
+  // mark one user of scheme as gone
+  void release(const std::string &scheme);
+
+  // open the handle of scheme on a background thread
+  void prewarm(const std::string &scheme);
+
+  // schemes without users that were last used before timeout
+  std::vector<std::string> idle(std::chrono::seconds timeout);
+
+  void close(const std::string &scheme);
+
+  // apply settings to the handle of scheme unless they are already in effect
+  void configure(const std::string &scheme, VarnamHandleKind kind,
+                 const VarnamHandleSettings &settings);
+
+  std::vector<std::string> schemes();
+
+private:
+  struct Handle {
+    int handle = 0;
+    bool configured = false;
+    VarnamHandleSettings settings{};
+  };
+
+  struct Entry {
+    Handle full;
+    Handle tokenizer;
+    int users = 0;
+    std::chrono::steady_clock::time_point lastUsed;
+  };
+
+  std::unordered_map<std::string, Entry> m_entries;
+
+  std::thread m_prewarmThread;
+  std::string m_prewarmScheme;
+  int m_prewarmHandle = 0;
+
+  static int open(const std::string &scheme);
+
+  static void close(const std::string &scheme, Handle &handle);
+
+  static void configure(Handle &handle, const VarnamHandleSettings &settings);
+
+  // adopt the handle opened by prewarm, if any
+  void waitPrewarm();
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_HANDLE_POOL_H_
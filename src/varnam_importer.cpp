@@ -0,0 +1,444 @@
+#include "varnam_importer.h"
+#include "varnam_backend.h"
+#include "varnam_utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sys/stat.h>
+
+extern "C" {
+#include <libgovarnam/libgovarnam.h>
+}
+
+namespace fcitx {
+
+namespace {
+
+constexpr size_t ChunkSize = 1 << 20;
+constexpr char CheckpointMagic[] = "varnam-import";
+
+// length of the UTF-8 sequence starting with lead, 0 if lead is invalid
+size_t sequenceLength(unsigned char lead) {
+  if (lead < 0x80) {
+    return 1;
+  } else if ((lead & 0xE0) == 0xC0) {
+    return 2;
+  } else if ((lead & 0xF0) == 0xE0) {
+    return 3;
+  } else if ((lead & 0xF8) == 0xF0) {
+    return 4;
+  }
+  return 0;
+}
+
+char32_t decode(const unsigned char *data, size_t length) {
+  if (length == 1) {
+    return data[0];
+  }
+  char32_t code = data[0] & (0xFF >> (length + 1));
+  for (size_t i = 1; i < length; i++) {
+    code = (code << 6) | (data[i] & 0x3F);
+  }
+  return code;
+}
+
+// Indic blocks from Devanagari to Sinhala and the zero width joiners
+bool isWordCharacter(char32_t code) {
+  return (code >= 0x0900 && code <= 0x0DFF) || code == 0x200C ||
+         code == 0x200D;
+}
+
+} // namespace
+
+VarnamCorpusImporter::VarnamCorpusImporter(Options options)
+    : m_options(std::move(options)) {
+  m_options.maxWords = std::max<size_t>(m_options.maxWords, 1);
+  m_options.batchWords = std::max<size_t>(m_options.batchWords, 1);
+  m_options.workers = std::max(m_options.workers, 1);
+}
+
+VarnamCorpusImporter::~VarnamCorpusImporter() { stopThreads(); }
+
+bool VarnamCorpusImporter::run(const ProgressCallback &progress) {
+  struct stat info;
+  if (stat(m_options.corpus.c_str(), &info) != 0) {
+    m_error = "cannot stat corpus: " + m_options.corpus;
+    return false;
+  }
+  m_corpusSize = info.st_size;
+  m_corpusMTime = info.st_mtime;
+
+  std::ifstream file(m_options.corpus, std::ios::binary);
+  if (!file) {
+    m_error = "cannot open corpus: " + m_options.corpus;
+    return false;
+  }
+
+  uint64_t offset = 0;
+  Weights pending;
+  bool resumed = m_options.resume &&
+                 loadCheckpoint(m_corpusSize, m_corpusMTime, offset, pending);
+  if (resumed && offset >= m_corpusSize && pending.empty()) {
+    VARNAM_INFO() << "corpus already imported: " << m_options.corpus;
+    return true;
+  }
+
+  if (!startThreads()) {
+    return false;
+  }
+
+  if (resumed) {
+    if (!pending.empty()) {
+      // the table written last may have been cut short
+      VARNAM_INFO() << "learning " << pending.size()
+                    << " words of the interrupted write again";
+      learn(pending);
+      pending = Weights();
+      saveCheckpoint(offset);
+    }
+    VARNAM_INFO() << "resuming import at byte " << offset;
+    file.seekg(offset);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  m_progress = Progress{};
+  m_progress.bytesRead = offset;
+  m_progress.totalBytes = m_corpusSize;
+  auto report = [&]() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_progress.words = m_words;
+      m_progress.learned = m_learned;
+      m_progress.failed = m_failed;
+    }
+    m_progress.seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    if (progress) {
+      progress(m_progress);
+    }
+  };
+
+  std::vector<char> chunk(ChunkSize);
+  std::string carry;
+  while (!m_cancelled && file) {
+    file.read(chunk.data(), chunk.size());
+    size_t read = file.gcount();
+    if (read == 0) {
+      break;
+    }
+    m_progress.bytesRead += read;
+    // cut at the last word boundary, the unfinished word goes with the
+    // next chunk
+    std::string piece;
+    piece.reserve(carry.size() + read);
+    piece.append(carry).append(chunk.data(), read);
+    size_t end = splitPoint(piece);
+    carry.assign(piece, end, std::string::npos);
+    piece.resize(end);
+    queuePiece(std::move(piece));
+    if (tableFull()) {
+      handOff(m_progress.bytesRead - carry.size());
+    }
+    report();
+  }
+
+  if (!m_cancelled && !carry.empty()) {
+    // the last word ends with the corpus
+    queuePiece(std::move(carry));
+    carry.clear();
+  }
+  handOff(m_progress.bytesRead - carry.size());
+  stopThreads();
+  report();
+  return true;
+}
+
+size_t VarnamCorpusImporter::splitPoint(const std::string &data) {
+  // word characters are never ASCII, so any ASCII byte ends a word
+  for (size_t i = data.size(); i > 0; i--) {
+    if (static_cast<unsigned char>(data[i - 1]) < 0x80) {
+      return i;
+    }
+  }
+  // no boundary at all, at least keep the last sequence whole
+  for (size_t i = data.size(); i > 0; i--) {
+    if ((static_cast<unsigned char>(data[i - 1]) & 0xC0) != 0x80) {
+      return i - 1 > 0 ? i - 1 : data.size();
+    }
+  }
+  return data.size();
+}
+
+uint64_t VarnamCorpusImporter::countWords(const std::string &data,
+                                          Counts &counts) {
+  auto bytes = reinterpret_cast<const unsigned char *>(data.data());
+  size_t size = data.size();
+  uint64_t words = 0;
+  size_t wordStart = std::string::npos;
+  bool skipping = false;
+  auto endWord = [&](size_t end) {
+    if (wordStart != std::string::npos) {
+      auto &count = counts[data.substr(wordStart, end - wordStart)];
+      count = std::min(count, std::numeric_limits<int>::max() - 1) + 1;
+      ++words;
+      wordStart = std::string::npos;
+    }
+    skipping = false;
+  };
+  size_t i = 0;
+  while (i < size) {
+    size_t length = sequenceLength(bytes[i]);
+    bool word = length > 0 && i + length <= size &&
+                isWordCharacter(decode(bytes + i, length));
+    if (word) {
+      if (skipping) {
+        // still inside a word that was too long
+      } else if (wordStart == std::string::npos) {
+        wordStart = i;
+      } else if (i + length - wordStart > MaxWordBytes) {
+        wordStart = std::string::npos;
+        skipping = true;
+      }
+    } else {
+      endWord(i);
+    }
+    i += std::max<size_t>(length, 1);
+  }
+  endWord(std::min(i, size));
+  return words;
+}
+
+void VarnamCorpusImporter::queuePiece(std::string piece) {
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // two pieces per tokenizer keep them busy while bounding memory
+    m_tokenizedCond.wait(lock, [this] {
+      return m_pieces.size() < static_cast<size_t>(m_options.workers) * 2;
+    });
+    m_pieces.push_back(std::move(piece));
+  }
+  m_pieceCond.notify_one();
+}
+
+bool VarnamCorpusImporter::tableFull() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_counts.size() >= m_options.maxWords;
+}
+
+void VarnamCorpusImporter::handOff(uint64_t offset) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_tokenizedCond.wait(
+      lock, [this] { return m_pieces.empty() && m_tokenizing == 0; });
+  // one table is written at a time, the next one is built meanwhile
+  m_writtenCond.wait(lock, [this] { return !m_writePending; });
+  if (m_counts.empty()) {
+    lock.unlock();
+    saveCheckpoint(offset);
+    return;
+  }
+  m_writeTable = std::move(m_counts);
+  m_counts = Counts();
+  m_writeOffset = offset;
+  m_writePending = true;
+  lock.unlock();
+  m_writeCond.notify_one();
+}
+
+bool VarnamCorpusImporter::startThreads() {
+  auto backend = VarnamBackend::get();
+  int rv = backend->init(m_options.scheme, &m_handle);
+  if (rv != VARNAM_SUCCESS) {
+    m_error = "cannot open scheme: " + m_options.scheme;
+    m_handle = 0;
+    return false;
+  }
+  m_stop = false;
+  m_writer = std::thread(&VarnamCorpusImporter::write, this);
+  for (int i = 0; i < m_options.workers; i++) {
+    m_tokenizers.emplace_back(&VarnamCorpusImporter::tokenize, this);
+  }
+  return true;
+}
+
+void VarnamCorpusImporter::stopThreads() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_pieceCond.notify_all();
+  m_writeCond.notify_all();
+  for (auto &tokenizer : m_tokenizers) {
+    tokenizer.join();
+  }
+  m_tokenizers.clear();
+  if (m_writer.joinable()) {
+    m_writer.join();
+  }
+  if (m_handle > 0) {
+    VarnamBackend::get()->close(m_handle);
+    m_handle = 0;
+  }
+}
+
+void VarnamCorpusImporter::tokenize() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_pieceCond.wait(lock, [this] { return m_stop || !m_pieces.empty(); });
+    if (m_pieces.empty() && m_stop) {
+      break;
+    }
+    std::string piece = std::move(m_pieces.front());
+    m_pieces.pop_front();
+    ++m_tokenizing;
+    lock.unlock();
+    m_tokenizedCond.notify_all();
+
+    Counts counts;
+    uint64_t words = countWords(piece, counts);
+
+    lock.lock();
+    for (auto &[word, count] : counts) {
+      auto &total = m_counts[word];
+      total = std::min(total, std::numeric_limits<int>::max() - count) + count;
+    }
+    m_words += words;
+    --m_tokenizing;
+    m_tokenizedCond.notify_all();
+  }
+}
+
+void VarnamCorpusImporter::write() {
+  auto backend = VarnamBackend::get();
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_writeCond.wait(lock, [this] { return m_stop || m_writePending; });
+    if (!m_writePending && m_stop) {
+      break;
+    }
+    Counts table = std::move(m_writeTable);
+    m_writeTable = Counts();
+    uint64_t offset = m_writeOffset;
+    lock.unlock();
+
+    // add the corpus counts to the current weights and save the result
+    // before learning any of it
+    Weights weights;
+    weights.reserve(table.size());
+    uint64_t failed = 0;
+    for (auto &[word, count] : table) {
+      int current = 0;
+      if (backend->weight(m_handle, word, &current) != VARNAM_SUCCESS) {
+        ++failed;
+        continue;
+      }
+      int weight =
+          std::min(current, std::numeric_limits<int>::max() - count) + count;
+      weights.emplace_back(word, weight);
+    }
+    table = Counts();
+    saveCheckpoint(offset, weights);
+    learn(weights);
+    weights = Weights();
+    saveCheckpoint(offset);
+
+    lock.lock();
+    m_failed += failed;
+    m_writePending = false;
+    m_writtenCond.notify_all();
+  }
+}
+
+void VarnamCorpusImporter::learn(const Weights &weights) {
+  auto backend = VarnamBackend::get();
+  uint64_t learned = 0;
+  uint64_t failed = 0;
+  size_t written = 0;
+  for (const auto &[word, weight] : weights) {
+    if (backend->learn(m_handle, word, weight) == VARNAM_SUCCESS) {
+      ++learned;
+    } else {
+      ++failed;
+    }
+    if (++written % m_options.batchWords == 0) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_learned += learned;
+      m_failed += failed;
+      learned = 0;
+      failed = 0;
+    }
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_learned += learned;
+  m_failed += failed;
+}
+
+bool VarnamCorpusImporter::loadCheckpoint(uint64_t size, int64_t mtime,
+                                          uint64_t &offset,
+                                          Weights &pending) {
+  if (m_options.statePath.empty()) {
+    return false;
+  }
+  std::ifstream file(m_options.statePath);
+  std::string magic;
+  uint64_t savedSize = 0;
+  int64_t savedMTime = 0;
+  uint64_t savedOffset = 0;
+  size_t savedWords = 0;
+  if (!(file >> magic >> savedSize >> savedMTime >> savedOffset) ||
+      magic != CheckpointMagic) {
+    return false;
+  }
+  // older state files end here, with nothing pending
+  if (!(file >> savedWords)) {
+    savedWords = 0;
+  }
+  if (savedSize != size || savedMTime != mtime || savedOffset > size) {
+    VARNAM_WARN() << "corpus changed since the last import, starting over";
+    return false;
+  }
+  // words never contain ASCII whitespace
+  Weights weights;
+  weights.reserve(savedWords);
+  for (size_t i = 0; i < savedWords; i++) {
+    int weight = 0;
+    std::string word;
+    if (!(file >> weight >> word)) {
+      VARNAM_WARN() << "import state is damaged, starting over";
+      return false;
+    }
+    weights.emplace_back(std::move(word), weight);
+  }
+  offset = savedOffset;
+  pending = std::move(weights);
+  return true;
+}
+
+void VarnamCorpusImporter::saveCheckpoint(uint64_t offset,
+                                          const Weights &pending) {
+  if (m_options.statePath.empty()) {
+    return;
+  }
+  // replace the checkpoint atomically, a crash keeps the previous one
+  std::string temp = m_options.statePath + ".tmp";
+  {
+    std::ofstream file(temp, std::ios::trunc);
+    file << CheckpointMagic << " " << m_corpusSize << " " << m_corpusMTime
+         << " " << offset << " " << pending.size() << "\n";
+    for (const auto &[word, weight] : pending) {
+      file << weight << " " << word << "\n";
+    }
+    if (!file.flush()) {
+      VARNAM_WARN() << "cannot write import state: " << temp;
+      return;
+    }
+  }
+  if (std::rename(temp.c_str(), m_options.statePath.c_str()) != 0) {
+    VARNAM_WARN() << "cannot write import state: " << m_options.statePath;
+  }
+}
+
+} // namespace fcitx
@@ -0,0 +1,148 @@
+#ifndef _FCITX5_VARNAM_IMPORTER_H_
+#define _FCITX5_VARNAM_IMPORTER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fcitx {
+
+// Streams a UTF-8 corpus into the learned words of a scheme. The corpus is
+// read in chunks that a pool of tokenizer threads splits into Indic words,
+// frequencies are aggregated in a bounded table and every time the table
+// fills up it is handed to a single writer thread with its own handle.
+// govarnam keeps the learnings in one SQLite database that serializes
+// writes, so the words are written by one thread while the next table is
+// built.
+//
+// The corpus count of a word is added to the weight it already has. Before
+// a table is written, the new weight of each of its words is saved to the
+// state file along with the position in the corpus after the table, so an
+// interrupted import continues from there. The saved weights are absolute,
+// learning them again on resume neither loses nor doubles any count.
+class VarnamCorpusImporter {
+public:
+  struct Options {
+    std::string scheme;
+    std::string corpus;
+    // checkpoint file, no checkpoints when empty
+    std::string statePath;
+    // continue from the checkpoint when it matches the corpus
+    bool resume = true;
+    // distinct words aggregated before they are written out
+    size_t maxWords = 200000;
+    // words learned between progress updates of the writer
+    size_t batchWords = 5000;
+    // threads splitting the corpus into words
+    int workers = 2;
+  };
+
+  struct Progress {
+    uint64_t bytesRead;
+    uint64_t totalBytes;
+    // words found in the corpus
+    uint64_t words;
+    // distinct words written to govarnam
+    uint64_t learned;
+    uint64_t failed;
+    double seconds;
+  };
+
+  using ProgressCallback = std::function<void(const Progress &)>;
+
+  // words longer than this are skipped
+  static constexpr size_t MaxWordBytes = 256;
+
+  VarnamCorpusImporter(Options options);
+
+  ~VarnamCorpusImporter();
+
+  // Import the corpus, progress is called after every chunk. Returns false
+  // on error, see error(). An import stopped by cancel() returns true
+  // with the checkpoint saved.
+  bool run(const ProgressCallback &progress);
+
+  // stop after the current chunk, safe to call from any thread
+  void cancel() { m_cancelled = true; }
+
+  bool cancelled() const { return m_cancelled; }
+
+  const std::string &error() const { return m_error; }
+
+private:
+  using Counts = std::unordered_map<std::string, int>;
+  // words and the absolute weight to learn them with
+  using Weights = std::vector<std::pair<std::string, int>>;
+
+  Options m_options;
+  std::string m_error;
+  std::atomic<bool> m_cancelled{false};
+  Progress m_progress{};
+  uint64_t m_corpusSize = 0;
+  int64_t m_corpusMTime = 0;
+
+  std::mutex m_mutex;
+  bool m_stop = false;
+  // pieces of the corpus waiting for a tokenizer
+  std::deque<std::string> m_pieces;
+  int m_tokenizing = 0;
+  std::condition_variable m_pieceCond;
+  std::condition_variable m_tokenizedCond;
+  Counts m_counts;
+  uint64_t m_words = 0;
+  std::vector<std::thread> m_tokenizers;
+
+  // table being written and the corpus offset to save once it is
+  Counts m_writeTable;
+  uint64_t m_writeOffset = 0;
+  bool m_writePending = false;
+  std::condition_variable m_writeCond;
+  std::condition_variable m_writtenCond;
+  uint64_t m_learned = 0;
+  uint64_t m_failed = 0;
+  int m_handle = 0;
+  std::thread m_writer;
+
+  bool startThreads();
+  void stopThreads();
+
+  // tokenizer and writer thread main loops
+  void tokenize();
+  void write();
+
+  // learn the words of weights, counting them into m_learned and m_failed
+  void learn(const Weights &weights);
+
+  // queue piece for the tokenizers, waits while too many are queued
+  void queuePiece(std::string piece);
+
+  bool tableFull();
+
+  // wait for the tokenizers and hand the table to the writer, offset is
+  // where the corpus continues after the words in the table
+  void handOff(uint64_t offset);
+
+  // count the words of data into counts, returns the number of words
+  static uint64_t countWords(const std::string &data, Counts &counts);
+
+  // length of the part of data that ends at a word boundary
+  static size_t splitPoint(const std::string &data);
+
+  // offset and the weights of the table that may not be written yet
+  bool loadCheckpoint(uint64_t size, int64_t mtime, uint64_t &offset,
+                      Weights &pending);
+  void saveCheckpoint(uint64_t offset, const Weights &pending = {});
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_IMPORTER_H_
@@ -0,0 +1,115 @@
+#include "varnam_inscript.h"
+#include "varnam_backend.h"
+#include "varnam_transliterator.h"
+#include "varnam_utils.h"
+
+#include <fcitx-utils/utf8.h>
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+extern "C" {
+#include <libgovarnam/libgovarnam.h>
+}
+
+namespace fcitx {
+
+bool VarnamInscriptTable::shifted(FcitxKeySym key) {
+  static constexpr std::string_view ShiftedSymbols = "~!@#$%^&*()_+{}|:\"<>?";
+  return (key >= FcitxKey_A && key <= FcitxKey_Z) ||
+         ShiftedSymbols.find(static_cast<char>(key)) != std::string_view::npos;
+}
+
+bool VarnamInscriptTable::isVowel(const std::string &text,
+                                  uint32_t *offset) {
+  // vowels sit at the same offsets of every Indic block up to Malayalam
+  uint32_t code = utf8::getChar(text);
+  if (code == utf8::INVALID_CHAR || code < 0x0900 || code > 0x0D7F) {
+    return false;
+  }
+  uint32_t position = code & 0x7F;
+  if (offset) {
+    *offset = position;
+  }
+  return (position >= 0x05 && position <= 0x14) ||
+         (position >= 0x3E && position <= 0x4C) ||
+         (position >= 0x60 && position <= 0x63);
+}
+
+bool VarnamInscriptTable::isVowelSign(const std::string &text) {
+  uint32_t offset = 0;
+  return isVowel(text, &offset) &&
+         ((offset >= 0x3E && offset <= 0x4C) || offset >= 0x62);
+}
+
+void VarnamInscriptTable::build(int varnamHandle) {
+  if (m_built && m_varnamHandle == varnamHandle) {
+    return;
+  }
+  auto backend = VarnamBackend::get();
+  std::vector<VarnamSymbol> symbols;
+  size_t mapped = 0;
+  // unshifted vowel keys that still type an independent vowel
+  std::string independent;
+  for (FcitxKeySym key = FirstKey; key <= LastKey;
+       key = static_cast<FcitxKeySym>(key + 1)) {
+    auto &text = m_keys[key - FirstKey];
+    text.clear();
+    if (varnamHandle <= 0) {
+      continue;
+    }
+    std::string pattern(1, static_cast<char>(key));
+    bool vowel = false;
+    if (backend->symbols(varnamHandle, pattern, symbols) == VARNAM_SUCCESS &&
+        !symbols.empty()) {
+      const auto &symbol = symbols.front();
+      vowel = symbol.vowel;
+      text = vowel && !shifted(key) && !symbol.value2.empty() ? symbol.value2
+                                                               : symbol.value1;
+    } else {
+      // a lone vowel key transliterates to the independent vowel, the
+      // check below reports it
+      std::vector<std::string> result;
+      int rv = VarnamTransliterator::transliterate(varnamHandle, pattern,
+                                                   result);
+      if (rv == VARNAM_SUCCESS && !result.empty()) {
+        text = std::move(result.front());
+        vowel = isVowel(text);
+      }
+    }
+    if (text.empty()) {
+      continue;
+    }
+    ++mapped;
+    if (vowel && !shifted(key) && !isVowelSign(text)) {
+      independent += pattern;
+    }
+  }
+  m_varnamHandle = varnamHandle;
+  m_built = true;
+  if (varnamHandle > 0 && mapped == 0) {
+    VARNAM_WARN() << "scheme maps no InScript keys";
+  } else if (!independent.empty()) {
+    VARNAM_WARN() << "InScript keys type independent vowels instead of "
+                     "vowel signs: "
+                  << independent;
+  }
+}
+
+void VarnamInscriptTable::clear() {
+  for (auto &text : m_keys) {
+    text.clear();
+  }
+  m_built = false;
+}
+
+const std::string *VarnamInscriptTable::text(FcitxKeySym key) const {
+  if (!m_built || key < FirstKey || key > LastKey) {
+    return nullptr;
+  }
+  const auto &text = m_keys[key - FirstKey];
+  return text.empty() ? nullptr : &text;
+}
+
+} // namespace fcitx
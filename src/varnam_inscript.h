@@ -0,0 +1,49 @@
+#ifndef _FCITX5_VARNAM_INSCRIPT_H_
+#define _FCITX5_VARNAM_INSCRIPT_H_
+
+#include <fcitx-utils/key.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace fcitx {
+
+// Key map of an InScript scheme. InScript gives every key a fixed
+// character, so the whole map is read from the scheme's symbol table once
+// when the table is built and keys are committed straight from it
+// afterwards. An unshifted vowel key types the vowel sign, the independent
+// vowel is on the shifted key.
+class VarnamInscriptTable {
+public:
+  // Look up every printable ASCII key on varnamHandle, transliterating
+  // the keys missing from the symbol table. Does nothing when the table was
+  // already built from the same handle.
+  void build(int varnamHandle);
+
+  // forget the table, the next build() looks everything up again
+  void clear();
+
+  // text key types, nullptr if the scheme does not map key
+  const std::string *text(FcitxKeySym key) const;
+
+private:
+  static constexpr FcitxKeySym FirstKey = FcitxKey_exclam;
+  static constexpr FcitxKeySym LastKey = FcitxKey_asciitilde;
+
+  // whether key needs shift on a US layout
+  static bool shifted(FcitxKeySym key);
+
+  // whether text starts with an independent vowel or a dependent vowel
+  // sign, offset is the position of the character in its Indic block
+  static bool isVowel(const std::string &text, uint32_t *offset = nullptr);
+  static bool isVowelSign(const std::string &text);
+
+  std::array<std::string, LastKey - FirstKey + 1> m_keys;
+  int m_varnamHandle = 0;
+  bool m_built = false;
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_INSCRIPT_H_
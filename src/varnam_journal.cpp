@@ -0,0 +1,264 @@
+#include "varnam_journal.h"
+#include "varnam_backend.h"
+#include "varnam_utils.h"
+
+#include <fcitx-utils/fs.h>
+#include <fcitx-utils/standardpath.h>
+#include <fcitx-utils/stringutils.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern "C" {
+#include <libgovarnam/libgovarnam.h>
+}
+
+namespace fcitx {
+
+namespace {
+
+constexpr char JournalFile[] = "varnam/learn.journal";
+constexpr char ReplaySuffix[] = ".replay";
+
+constexpr char LearnRecord = 'L';
+constexpr char UnlearnRecord = 'U';
+// the word's records before this one have been written
+constexpr char AppliedRecord = 'A';
+
+// record header: operation, scheme length, word length (little endian)
+constexpr size_t HeaderSize = 4;
+
+bool fileSize(const std::string &path, off_t &size) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return false;
+  }
+  size = st.st_size;
+  return true;
+}
+
+} // namespace
+
+VarnamLearnJournal::VarnamLearnJournal(Instance *instance)
+    : m_instance(instance), m_alive(std::make_shared<bool>(true)),
+      m_path(stringutils::concat(
+          StandardPath::global().userDirectory(StandardPath::Type::PkgData),
+          "/", JournalFile)) {}
+
+VarnamLearnJournal::~VarnamLearnJournal() {
+  m_stop = true;
+  if (m_replayThread.joinable()) {
+    m_replayThread.join();
+  }
+  m_alive.reset();
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+  if (m_replayFd >= 0) {
+    close(m_replayFd);
+  }
+}
+
+void VarnamLearnJournal::learn(std::string_view scheme,
+                               std::string_view word) {
+  append(LearnRecord, scheme, word);
+}
+
+void VarnamLearnJournal::unlearn(std::string_view scheme,
+                                 std::string_view word) {
+  append(UnlearnRecord, scheme, word);
+}
+
+void VarnamLearnJournal::encode(std::string &out, char operation,
+                                std::string_view scheme,
+                                std::string_view word) {
+  out.reserve(out.size() + HeaderSize + scheme.size() + word.size());
+  out += operation;
+  out += static_cast<char>(scheme.size());
+  out += static_cast<char>(word.size() & 0xFF);
+  out += static_cast<char>(word.size() >> 8);
+  out.append(scheme).append(word);
+}
+
+void VarnamLearnJournal::append(char operation, std::string_view scheme,
+                                std::string_view word) {
+  if (scheme.size() > UINT8_MAX || word.size() > UINT16_MAX) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_open) {
+    encode(m_early, operation, scheme, word);
+    return;
+  }
+  if (m_fd < 0) {
+    return;
+  }
+  std::string record;
+  encode(record, operation, scheme, word);
+  // O_APPEND keeps a record in one piece, no fsync on the key path
+  if (fs::safeWrite(m_fd, record.data(), record.size()) !=
+      static_cast<ssize_t>(record.size())) {
+    VARNAM_WARN() << "cannot append to learn journal: " << m_path;
+  }
+}
+
+void VarnamLearnJournal::clear() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_open) {
+    m_early.clear();
+    return;
+  }
+  if (m_fd >= 0 && ftruncate(m_fd, 0) != 0) {
+    VARNAM_WARN() << "cannot truncate learn journal: " << m_path;
+  }
+}
+
+void VarnamLearnJournal::replay(ReplayCallback callback) {
+  if (m_replayThread.joinable()) {
+    return;
+  }
+  m_replayThread =
+      std::thread(&VarnamLearnJournal::run, this, std::move(callback));
+}
+
+void VarnamLearnJournal::run(ReplayCallback callback) {
+  fs::makePath(fs::dirName(m_path));
+  // move the records of the previous session aside, after an interrupted
+  // replay they are added to the ones still waiting
+  std::string replayPath = m_path + ReplaySuffix;
+  off_t size = 0;
+  if (fileSize(m_path, size) && size > 0) {
+    off_t replaySize = 0;
+    if (fileSize(replayPath, replaySize)) {
+      std::ifstream in(m_path, std::ios::binary);
+      std::ofstream out(replayPath, std::ios::binary | std::ios::app);
+      out << in.rdbuf();
+    } else {
+      std::rename(m_path.c_str(), replayPath.c_str());
+    }
+  }
+  open();
+  if (m_stop || !fileSize(replayPath, size)) {
+    return;
+  }
+  auto entries = read(replayPath);
+  if (entries.empty()) {
+    unlink(replayPath.c_str());
+    return;
+  }
+  int fd = ::open(replayPath.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+  if (fd < 0) {
+    VARNAM_WARN() << "cannot open learn journal: " << replayPath;
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_replayFd = fd;
+    m_replayLeft = entries.size();
+  }
+  VARNAM_INFO() << "replaying learn journal: " << entries.size() << " words";
+  std::weak_ptr<bool> alive = m_alive;
+  m_instance->eventDispatcher().schedule(
+      [alive, callback = std::move(callback),
+       entries = std::move(entries)]() mutable {
+        if (alive.expired()) {
+          return;
+        }
+        callback(std::move(entries));
+      });
+}
+
+void VarnamLearnJournal::applied(std::string_view scheme,
+                                 std::string_view word) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_replayFd < 0) {
+    return;
+  }
+  std::string record;
+  encode(record, AppliedRecord, scheme, word);
+  if (fs::safeWrite(m_replayFd, record.data(), record.size()) !=
+      static_cast<ssize_t>(record.size())) {
+    VARNAM_WARN() << "cannot append to learn journal: " << m_path
+                  << ReplaySuffix;
+  }
+  if (m_replayLeft > 0 && --m_replayLeft == 0) {
+    close(m_replayFd);
+    m_replayFd = -1;
+    unlink((m_path + ReplaySuffix).c_str());
+    VARNAM_INFO() << "replayed learn journal";
+  }
+}
+
+void VarnamLearnJournal::open() {
+  int fd = ::open(m_path.c_str(),
+                  O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    VARNAM_WARN() << "cannot open learn journal: " << m_path;
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_fd = fd;
+  m_open = true;
+  if (m_fd >= 0 && !m_early.empty() &&
+      fs::safeWrite(m_fd, m_early.data(), m_early.size()) !=
+          static_cast<ssize_t>(m_early.size())) {
+    VARNAM_WARN() << "cannot append to learn journal: " << m_path;
+  }
+  m_early.clear();
+  m_early.shrink_to_fit();
+}
+
+std::vector<VarnamLearnJournal::Entry>
+VarnamLearnJournal::read(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  std::string data((std::istreambuf_iterator<char>(file)),
+                   std::istreambuf_iterator<char>());
+
+  PendingMap pending;
+  size_t offset = 0;
+  while (offset + HeaderSize <= data.size()) {
+    char operation = data[offset];
+    size_t schemeSize = static_cast<unsigned char>(data[offset + 1]);
+    size_t wordSize = static_cast<unsigned char>(data[offset + 2]) |
+                      static_cast<unsigned char>(data[offset + 3]) << 8;
+    if ((operation != LearnRecord && operation != UnlearnRecord &&
+         operation != AppliedRecord) ||
+        offset + HeaderSize + schemeSize + wordSize > data.size()) {
+      // torn or corrupted tail
+      break;
+    }
+    offset += HeaderSize;
+    std::pair<std::string, std::string> key{
+        data.substr(offset, schemeSize),
+        data.substr(offset + schemeSize, wordSize)};
+    offset += schemeSize + wordSize;
+    if (operation == AppliedRecord) {
+      pending.erase(key);
+      continue;
+    }
+    auto [it, inserted] =
+        pending.try_emplace(std::move(key), Pending{operation, 1});
+    if (!inserted) {
+      if (it->second.operation == operation && operation == LearnRecord) {
+        ++it->second.count;
+      } else {
+        it->second = Pending{operation, 1};
+      }
+    }
+  }
+
+  std::vector<Entry> entries;
+  entries.reserve(pending.size());
+  for (auto &[key, request] : pending) {
+    entries.push_back(Entry{request.operation == LearnRecord, key.first,
+                            key.second, request.count});
+  }
+  return entries;
+}
+
+} // namespace fcitx
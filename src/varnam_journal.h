@@ -0,0 +1,105 @@
+#ifndef _FCITX5_VARNAM_JOURNAL_H_
+#define _FCITX5_VARNAM_JOURNAL_H_
+
+#include <fcitx/instance.h>
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace fcitx {
+
+// Append only log of the learn/unlearn requests the learner has not
+// written yet, kept in the user data dir. Records are appended with a
+// single write() and never synced, that is enough to survive fcitx being
+// killed. The learner clears the journal whenever its queue is empty.
+//
+// Nothing touches the disk on construction. replay() moves the journal
+// left behind by the previous session aside, opens the one of this
+// session and reads the old records on a background thread. Records of
+// the same word are merged and handed to the main thread, the learner
+// writes them with the other words. Every word written is marked applied
+// in the old journal, which is removed once all of them are. A replay cut
+// short continues with the unmarked words at the next start. Records
+// appended before the journal is open are kept in memory until then.
+class VarnamLearnJournal {
+public:
+  // a word of the previous session
+  struct Entry {
+    bool learned;
+    std::string scheme;
+    std::string word;
+    // uses of a learned word
+    int count;
+  };
+
+  using ReplayCallback = std::function<void(std::vector<Entry> entries)>;
+
+  VarnamLearnJournal(Instance *instance);
+
+  ~VarnamLearnJournal();
+
+  void learn(std::string_view scheme, std::string_view word);
+
+  void unlearn(std::string_view scheme, std::string_view word);
+
+  // drop every record, called once all of them have been written
+  void clear();
+
+  // open the journal and read the one of the previous session on a
+  // background thread, its words are passed to callback on the main thread
+  void replay(ReplayCallback callback);
+
+  // mark a word passed to the replay callback as written
+  void applied(std::string_view scheme, std::string_view word);
+
+private:
+  // later requests of a word win, repeated learns add up
+  struct Pending {
+    char operation;
+    int count;
+  };
+  using PendingMap = std::map<std::pair<std::string, std::string>, Pending>;
+
+  Instance *m_instance;
+  std::shared_ptr<bool> m_alive;
+  std::string m_path;
+  std::mutex m_mutex;
+  int m_fd = -1;
+  bool m_open = false;
+  // records appended before the journal was opened
+  std::string m_early;
+  // journal of the previous session and its words not applied yet
+  int m_replayFd = -1;
+  size_t m_replayLeft = 0;
+  std::atomic<bool> m_stop{false};
+  std::thread m_replayThread;
+
+  void append(char operation, std::string_view scheme,
+              std::string_view word);
+
+  // replay thread: move the old journal aside, open this one and read
+  // the old records
+  void run(ReplayCallback callback);
+
+  // open the journal of this session and write the early records to it
+  void open();
+
+  // merge the records of path, dropping the words already applied
+  static std::vector<Entry> read(const std::string &path);
+
+  static void encode(std::string &out, char operation,
+                     std::string_view scheme, std::string_view word);
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_JOURNAL_H_
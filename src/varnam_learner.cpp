@@ -0,0 +1,268 @@
+#include "varnam_learner.h"
+#include "varnam_utils.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace fcitx {
+
+VarnamLearner::VarnamLearner(Instance *instance, VarnamLearnJournal *journal,
+                             WrittenCallback written)
+    : m_instance(instance), m_alive(std::make_shared<bool>(true)),
+      m_journal(journal), m_writtenCallback(std::move(written)) {
+  m_thread = std::thread(&VarnamLearner::run, this);
+}
+
+VarnamLearner::~VarnamLearner() {
+  {
+    // the next start replays them again
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.erase(std::remove_if(m_queue.begin(), m_queue.end(),
+                                 [](const Request &request) {
+                                   return request.replayOnly;
+                                 }),
+                  m_queue.end());
+  }
+  flush();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_cond.notify_all();
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+  m_alive.reset();
+}
+
+void VarnamLearner::learn(const std::string &scheme, int varnamHandle,
+                          std::string word, const std::string &input,
+                          VarnamSchemeStats *stats) {
+  enqueue(Operation::Learn, scheme, varnamHandle, std::move(word), input,
+          stats);
+}
+
+void VarnamLearner::unlearn(const std::string &scheme, int varnamHandle,
+                            std::string word, VarnamSchemeStats *stats) {
+  enqueue(Operation::Unlearn, scheme, varnamHandle, std::move(word), {},
+          stats);
+}
+
+void VarnamLearner::replay(const VarnamLearnJournal::Entry &entry,
+                           int varnamHandle) {
+  auto operation = entry.learned ? Operation::Learn : Operation::Unlearn;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto pending = std::find_if(
+      m_queue.begin(), m_queue.end(), [&](const Request &request) {
+        return request.varnamHandle == varnamHandle &&
+               request.word == entry.word;
+      });
+  if (pending != m_queue.end()) {
+    ++m_stats.coalesced;
+    // the queued request is the later one and wins, repeated learns add up
+    if (pending->operation == operation && operation == Operation::Learn) {
+      pending->count += entry.count;
+    }
+    pending->replayed = true;
+    return;
+  }
+  // already in the journal of the previous session, and never dropped
+  m_queue.push_back(Request{operation, entry.scheme, varnamHandle, entry.word,
+                            entry.count, {}, nullptr, true, true});
+  ++m_stats.queued;
+}
+
+void VarnamLearner::enqueue(Operation operation, const std::string &scheme,
+                            int varnamHandle, std::string word,
+                            const std::string &input,
+                            VarnamSchemeStats *stats) {
+  bool notify = false;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto journal = [&]() {
+      if (!m_journal) {
+        return;
+      }
+      if (operation == Operation::Learn) {
+        m_journal->learn(scheme, word);
+      } else {
+        m_journal->unlearn(scheme, word);
+      }
+    };
+    auto pending = std::find_if(
+        m_queue.begin(), m_queue.end(), [&](const Request &request) {
+          return request.varnamHandle == varnamHandle && request.word == word;
+        });
+    auto addInput = [&input](Request &request) {
+      if (!input.empty() &&
+          std::find(request.inputs.begin(), request.inputs.end(), input) ==
+              request.inputs.end()) {
+        request.inputs.push_back(input);
+      }
+    };
+    if (pending != m_queue.end()) {
+      ++m_stats.coalesced;
+      pending->replayOnly = false;
+      if (pending->operation == operation) {
+        if (operation == Operation::Learn) {
+          ++pending->count;
+          addInput(*pending);
+          journal();
+        }
+        return;
+      }
+      journal();
+      // the later request wins, an unlearn drops the pending increments
+      pending->operation = operation;
+      pending->count = 1;
+      pending->inputs.clear();
+      addInput(*pending);
+      pending->stats = stats;
+      return;
+    }
+    if (m_queue.size() >= MaxPendingWords) {
+      ++m_stats.dropped;
+      VARNAM_WARN() << "learn queue full, dropping word:" << word;
+      return;
+    }
+    journal();
+    Request request{operation, scheme, varnamHandle, std::move(word), 1, {},
+                    stats, false, false};
+    addInput(request);
+    m_queue.push_back(std::move(request));
+    ++m_stats.queued;
+    notify = m_queue.size() >= m_flushThreshold;
+  }
+  if (notify) {
+    m_cond.notify_one();
+  }
+}
+
+void VarnamLearner::write() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_queue.empty()) {
+      return;
+    }
+    m_writeRequested = true;
+  }
+  m_cond.notify_one();
+}
+
+void VarnamLearner::flush() {
+  write();
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idleCond.wait(lock, [this] { return m_queue.empty() && !m_busy; });
+}
+
+void VarnamLearner::flush(const std::vector<int> &handles) {
+  auto onHandles = [&handles](int handle) {
+    return std::find(handles.begin(), handles.end(), handle) != handles.end();
+  };
+  auto pending = [&]() {
+    return std::any_of(m_queue.begin(), m_queue.end(),
+                       [&](const Request &request) {
+                         return onHandles(request.varnamHandle);
+                       }) ||
+           std::any_of(m_writing.begin(), m_writing.end(), onHandles);
+  };
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (!pending()) {
+    return;
+  }
+  m_writeRequested = true;
+  m_cond.notify_one();
+  m_idleCond.wait(lock, [&] { return !pending(); });
+}
+
+void VarnamLearner::setFlushThreshold(size_t words) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_flushThreshold = std::max<size_t>(words, 1);
+  }
+  m_cond.notify_one();
+}
+
+VarnamLearner::Stats VarnamLearner::stats() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Stats stats = m_stats;
+  stats.depth = m_queue.size();
+  return stats;
+}
+
+void VarnamLearner::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_cond.wait(lock, [this] {
+      return m_stop || (!m_queue.empty() &&
+                        (m_writeRequested ||
+                         m_queue.size() >= m_flushThreshold));
+    });
+    if (m_queue.empty() && m_stop) {
+      break;
+    }
+    m_writeRequested = false;
+    std::vector<Request> batch(std::make_move_iterator(m_queue.begin()),
+                               std::make_move_iterator(m_queue.end()));
+    m_queue.clear();
+    m_busy = true;
+    for (const auto &request : batch) {
+      if (std::find(m_writing.begin(), m_writing.end(),
+                    request.varnamHandle) == m_writing.end()) {
+        m_writing.push_back(request.varnamHandle);
+      }
+    }
+    lock.unlock();
+
+    for (const auto &request : batch) {
+      VarnamStageTimer timer(request.stats, VarnamStage::Learn);
+      if (request.operation == Operation::Learn) {
+        // one write of the current weight plus the uses since the last one
+        varnam_learn_word(request.varnamHandle, request.word, request.count);
+      } else {
+        varnam_unlearn_word(request.varnamHandle, request.word);
+      }
+      if (request.replayed && m_journal) {
+        m_journal->applied(request.scheme, request.word);
+      }
+    }
+
+    size_t written = batch.size();
+    notifyWritten(std::move(batch));
+
+    lock.lock();
+    m_busy = false;
+    m_writing.clear();
+    m_stats.written += written;
+    ++m_stats.writes;
+    if (m_journal && m_queue.empty()) {
+      m_journal->clear();
+    }
+    m_idleCond.notify_all();
+  }
+}
+
+void VarnamLearner::notifyWritten(std::vector<Request> batch) {
+  if (!m_writtenCallback) {
+    return;
+  }
+  std::vector<Written> written;
+  written.reserve(batch.size());
+  for (auto &request : batch) {
+    written.push_back(Written{request.operation == Operation::Learn,
+                              std::move(request.scheme),
+                              std::move(request.word),
+                              std::move(request.inputs)});
+  }
+  std::weak_ptr<bool> alive = m_alive;
+  m_instance->eventDispatcher().schedule(
+      [this, alive, written = std::move(written)]() mutable {
+        if (alive.expired()) {
+          return;
+        }
+        m_writtenCallback(std::move(written));
+      });
+}
+
+} // namespace fcitx
@@ -0,0 +1,139 @@
+#ifndef _FCITX5_VARNAM_LEARNER_H_
+#define _FCITX5_VARNAM_LEARNER_H_
+
+#include "varnam_journal.h"
+#include "varnam_stats.h"
+
+#include <fcitx/instance.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fcitx {
+
+// Single background worker applying learn/unlearn requests to govarnam.
+// Requests are aggregated per word on the main thread, a word learned n
+// times is written once with its weight raised by n. Pending words are
+// written when write() or flush() is called or once there are
+// flushThreshold of them.
+// Every accepted request is also appended to journal, which is cleared
+// whenever nothing is pending. After every write the written requests are
+// handed to the written callback on the fcitx main thread, results cached
+// in between still rank the words the old way.
+class VarnamLearner {
+public:
+  // a request that has been written to govarnam
+  struct Written {
+    bool learned;
+    std::string scheme;
+    std::string word;
+    // inputs the word was committed from, empty for an unlearn
+    std::vector<std::string> inputs;
+  };
+
+  using WrittenCallback = std::function<void(std::vector<Written> written)>;
+
+  struct Stats {
+    size_t depth;
+    uint64_t queued;
+    // requests folded into a pending one, each saves an engine write
+    uint64_t coalesced;
+    uint64_t dropped;
+    // engine writes, one per written word
+    uint64_t written;
+    // batches
+    uint64_t writes;
+  };
+
+  static constexpr size_t MaxPendingWords = 512;
+
+  VarnamLearner(Instance *instance, VarnamLearnJournal *journal = nullptr,
+                WrittenCallback written = {});
+
+  ~VarnamLearner();
+
+  // scheme is the scheme varnamHandle was opened for, for the journal,
+  // input is what the word was typed as
+  void learn(const std::string &scheme, int varnamHandle, std::string word,
+             const std::string &input, VarnamSchemeStats *stats = nullptr);
+
+  void unlearn(const std::string &scheme, int varnamHandle, std::string word,
+               VarnamSchemeStats *stats = nullptr);
+
+  // queue a word of the previous session's journal. It counts as older
+  // than the queued requests and is marked applied in the journal once
+  // written. Words queued only by replay are not written at shutdown.
+  void replay(const VarnamLearnJournal::Entry &entry, int varnamHandle);
+
+  // start writing the pending words without waiting for it
+  void write();
+
+  // block until every queued request has been written
+  void flush();
+
+  // block until the queued requests on handles have been written
+  void flush(const std::vector<int> &handles);
+
+  // number of pending words that triggers a write, 1 writes right away
+  void setFlushThreshold(size_t words);
+
+  Stats stats();
+
+private:
+  enum class Operation { Learn, Unlearn };
+
+  struct Request {
+    Operation operation;
+    std::string scheme;
+    int varnamHandle;
+    std::string word;
+    // times the word was learned since the last write
+    int count;
+    std::vector<std::string> inputs;
+    VarnamSchemeStats *stats;
+    // covers a word of the previous session's journal
+    bool replayed;
+    // and nothing else
+    bool replayOnly;
+  };
+
+  Instance *m_instance;
+  std::shared_ptr<bool> m_alive;
+  VarnamLearnJournal *m_journal;
+  WrittenCallback m_writtenCallback;
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::condition_variable m_idleCond;
+  // at most one request per handle and word
+  std::deque<Request> m_queue;
+  size_t m_flushThreshold = 1;
+  bool m_writeRequested = false;
+  bool m_busy = false;
+  // handles of the batch being written
+  std::vector<int> m_writing;
+  bool m_stop = false;
+  Stats m_stats{};
+  std::thread m_thread;
+
+  void enqueue(Operation operation, const std::string &scheme,
+               int varnamHandle, std::string word, const std::string &input,
+               VarnamSchemeStats *stats);
+
+  // hand a written batch to the written callback on the main thread
+  void notifyWritten(std::vector<Request> batch);
+
+  // worker thread main loop
+  void run();
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_LEARNER_H_
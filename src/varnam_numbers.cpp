@@ -0,0 +1,83 @@
+#include "varnam_numbers.h"
+#include "varnam_transliterator.h"
+
+extern "C" {
+#include <libgovarnam/libgovarnam.h>
+}
+
+namespace fcitx {
+
+namespace {
+
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+} // namespace
+
+bool VarnamNumberTable::isSeparator(char c) {
+  switch (c) {
+  case '-':
+  case '/':
+  case ':':
+  case '+':
+  case '#':
+  case '.':
+  case ',':
+    return true;
+  default:
+    return false;
+  }
+}
+
+void VarnamNumberTable::build(int varnamHandle, bool indic) {
+  if (m_built && m_varnamHandle == varnamHandle && m_indic == indic) {
+    return;
+  }
+  for (int digit = 0; digit < 10; digit++) {
+    std::string text(1, static_cast<char>('0' + digit));
+    if (indic && varnamHandle > 0) {
+      std::vector<std::string> result;
+      int rv = VarnamTransliterator::transliterate(varnamHandle, text, result);
+      if (rv == VARNAM_SUCCESS && !result.empty() && !result[0].empty()) {
+        text = std::move(result[0]);
+      }
+    }
+    m_digits[digit] = std::move(text);
+  }
+  m_varnamHandle = varnamHandle;
+  m_indic = indic;
+  m_built = true;
+}
+
+void VarnamNumberTable::clear() { m_built = false; }
+
+bool VarnamNumberTable::isNumber(std::string_view input) {
+  bool digits = false;
+  for (char c : input) {
+    if (isDigit(c)) {
+      digits = true;
+    } else if (!isSeparator(c)) {
+      return false;
+    }
+  }
+  return digits;
+}
+
+bool VarnamNumberTable::convert(std::string_view input,
+                                std::vector<std::string> &result) const {
+  if (!m_built || !isNumber(input)) {
+    return false;
+  }
+  result.resize(1);
+  auto &text = result[0];
+  text.clear();
+  for (char c : input) {
+    if (isDigit(c)) {
+      text.append(m_digits[c - '0']);
+    } else {
+      text.push_back(c);
+    }
+  }
+  return true;
+}
+
+} // namespace fcitx
@@ -0,0 +1,44 @@
+#ifndef _FCITX5_VARNAM_NUMBERS_H_
+#define _FCITX5_VARNAM_NUMBERS_H_
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fcitx {
+
+// Digits of a scheme, so numbers are converted without asking the engine.
+// With Indic numbers each digit is what the scheme makes of it, looked up
+// once when the table is built.
+class VarnamNumberTable {
+public:
+  // Look up the digits on varnamHandle, or keep ASCII digits when indic is
+  // false. Does nothing when the table was already built with the same
+  // arguments.
+  void build(int varnamHandle, bool indic);
+
+  // forget the table, the next build() looks everything up again
+  void clear();
+
+  // characters that may appear between the digits of phone numbers,
+  // dates, house numbers and amounts
+  static bool isSeparator(char c);
+
+  // true if input holds at least one digit and otherwise only separators
+  static bool isNumber(std::string_view input);
+
+  // Replace result with input written in the scheme's digits. Returns
+  // false and leaves result alone if input is no number.
+  bool convert(std::string_view input, std::vector<std::string> &result) const;
+
+private:
+  std::array<std::string, 10> m_digits;
+  int m_varnamHandle = 0;
+  bool m_indic = false;
+  bool m_built = false;
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_NUMBERS_H_
@@ -0,0 +1,122 @@
+#include "varnam_preedit.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace fcitx {
+
+void VarnamPreeditBuffer::insert(std::string_view text) {
+  reserveGap(text.size());
+  std::memcpy(&m_data[m_gapStart], text.data(), text.size());
+  m_gapStart += text.size();
+  size_t codepoints =
+      std::count_if(text.begin(), text.end(),
+                    [](char byte) { return !isContinuation(byte); });
+  m_cursor += codepoints;
+  m_length += codepoints;
+  m_textValid = false;
+}
+
+bool VarnamPreeditBuffer::erasePrevious() {
+  if (m_gapStart == 0) {
+    return false;
+  }
+  do {
+    --m_gapStart;
+  } while (m_gapStart > 0 && isContinuation(m_data[m_gapStart]));
+  --m_cursor;
+  --m_length;
+  m_textValid = false;
+  return true;
+}
+
+bool VarnamPreeditBuffer::eraseNext() {
+  if (m_gapEnd == m_data.size()) {
+    return false;
+  }
+  do {
+    ++m_gapEnd;
+  } while (m_gapEnd < m_data.size() && isContinuation(m_data[m_gapEnd]));
+  --m_length;
+  m_textValid = false;
+  return true;
+}
+
+bool VarnamPreeditBuffer::moveLeft() {
+  if (m_gapStart == 0) {
+    return false;
+  }
+  // move the previous codepoint from before the gap to after it
+  do {
+    m_data[--m_gapEnd] = m_data[--m_gapStart];
+  } while (m_gapStart > 0 && isContinuation(m_data[m_gapEnd]));
+  --m_cursor;
+  return true;
+}
+
+bool VarnamPreeditBuffer::moveRight() {
+  if (m_gapEnd == m_data.size()) {
+    return false;
+  }
+  do {
+    m_data[m_gapStart++] = m_data[m_gapEnd++];
+  } while (m_gapEnd < m_data.size() && isContinuation(m_data[m_gapEnd]));
+  ++m_cursor;
+  return true;
+}
+
+void VarnamPreeditBuffer::moveToStart() {
+  std::memmove(&m_data[m_gapEnd - m_gapStart], m_data.data(), m_gapStart);
+  m_gapEnd -= m_gapStart;
+  m_gapStart = 0;
+  m_cursor = 0;
+}
+
+void VarnamPreeditBuffer::moveToEnd() {
+  size_t tail = m_data.size() - m_gapEnd;
+  std::memmove(&m_data[m_gapStart], &m_data[m_gapEnd], tail);
+  m_gapStart += tail;
+  m_gapEnd = m_data.size();
+  m_cursor = m_length;
+}
+
+void VarnamPreeditBuffer::clear() {
+  // keep the storage for the next word
+  m_gapStart = 0;
+  m_gapEnd = m_data.size();
+  m_cursor = 0;
+  m_length = 0;
+  m_textValid = false;
+}
+
+void VarnamPreeditBuffer::release() {
+  std::string().swap(m_data);
+  std::string().swap(m_text);
+  m_gapStart = 0;
+  m_gapEnd = 0;
+  m_cursor = 0;
+  m_length = 0;
+  m_textValid = true;
+}
+
+const std::string &VarnamPreeditBuffer::text() const {
+  if (!m_textValid) {
+    m_text.assign(m_data, 0, m_gapStart);
+    m_text.append(m_data, m_gapEnd, std::string::npos);
+    m_textValid = true;
+  }
+  return m_text;
+}
+
+void VarnamPreeditBuffer::reserveGap(size_t size) {
+  if (gapSize() >= size) {
+    return;
+  }
+  size_t tail = m_data.size() - m_gapEnd;
+  size_t grow = std::max({size - gapSize(), m_data.size(), MinGap});
+  m_data.resize(m_data.size() + grow);
+  std::memmove(&m_data[m_data.size() - tail], &m_data[m_gapEnd], tail);
+  m_gapEnd = m_data.size() - tail;
+}
+
+} // namespace fcitx
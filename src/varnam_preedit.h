@@ -0,0 +1,80 @@
+#ifndef _FCITX5_VARNAM_PREEDIT_H_
+#define _FCITX5_VARNAM_PREEDIT_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace fcitx {
+
+// Gap buffer holding the typed input. The gap always sits at the cursor,
+// so edits at the cursor only move bytes when the buffer has to grow.
+// The cursor is kept both as a codepoint index and as the byte offset
+// fcitx Text expects. text() hands out a contiguous copy that reuses its
+// storage, so steady state typing does not allocate.
+class VarnamPreeditBuffer {
+public:
+  bool empty() const { return size() == 0; }
+
+  // length in bytes
+  size_t size() const { return m_data.size() - gapSize(); }
+
+  // length in codepoints
+  size_t length() const { return m_length; }
+
+  // cursor position in codepoints
+  size_t cursor() const { return m_cursor; }
+
+  // cursor position in bytes
+  size_t cursorByte() const { return m_gapStart; }
+
+  // insert text before the cursor and move the cursor past it
+  void insert(std::string_view text);
+
+  // remove the codepoint before / after the cursor, false if there is none
+  bool erasePrevious();
+  bool eraseNext();
+
+  // move the cursor by one codepoint, false if it is already at the edge
+  bool moveLeft();
+  bool moveRight();
+
+  void moveToStart();
+  void moveToEnd();
+
+  void clear();
+
+  // clear and give the storage back
+  void release();
+
+  // heap bytes held by the buffer
+  size_t capacity() const { return m_data.capacity() + m_text.capacity(); }
+
+  // contiguous contents, valid until the next modification
+  const std::string &text() const;
+
+private:
+  static constexpr size_t MinGap = 16;
+
+  // contents before the gap, the gap, then contents after it
+  std::string m_data;
+  size_t m_gapStart = 0;
+  size_t m_gapEnd = 0;
+  size_t m_cursor = 0;
+  size_t m_length = 0;
+  mutable std::string m_text;
+  mutable bool m_textValid = true;
+
+  size_t gapSize() const { return m_gapEnd - m_gapStart; }
+
+  // make room for at least size bytes in the gap
+  void reserveGap(size_t size);
+
+  static bool isContinuation(char byte) {
+    return (static_cast<unsigned char>(byte) & 0xC0) == 0x80;
+  }
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_PREEDIT_H_
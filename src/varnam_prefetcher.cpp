@@ -0,0 +1,130 @@
+#include "varnam_prefetcher.h"
+#include "varnam_cache.h"
+#include "varnam_transliterator.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace fcitx {
+
+namespace {
+
+// starting ranking before anything was typed, vowels and the consonants
+// most Indic romanizations use, most common first
+constexpr char SeedLetters[] = "aiuekmnrtlvsdpyhgjbcoA";
+
+} // namespace
+
+VarnamPrefetcher::VarnamPrefetcher(VarnamTransliterator *transliterator)
+    : m_transliterator(transliterator) {}
+
+VarnamPrefetcher::~VarnamPrefetcher() { stop(); }
+
+VarnamPrefetcher::Frequencies &
+VarnamPrefetcher::frequencies(const std::string &scheme) {
+  auto it = m_frequencies.find(scheme);
+  if (it == m_frequencies.end()) {
+    it = m_frequencies.emplace(scheme, Frequencies{}).first;
+    uint32_t seed = sizeof(SeedLetters) - 1;
+    for (const char *letter = SeedLetters; *letter; letter++) {
+      it->second[static_cast<unsigned char>(*letter)] = seed--;
+    }
+  }
+  return it->second;
+}
+
+void VarnamPrefetcher::observe(const std::string &scheme, char letter) {
+  auto index = static_cast<unsigned char>(letter);
+  if (index < 128) {
+    ++frequencies(scheme)[index];
+  }
+}
+
+void VarnamPrefetcher::start(const std::string &scheme, int varnamHandle,
+                             VarnamResultCache *cache,
+                             const std::string &input, int limit,
+                             std::chrono::milliseconds budget) {
+  stop();
+  if (limit <= 0 || input.empty() || !cache) {
+    return;
+  }
+  const auto &counts = frequencies(scheme);
+  std::array<unsigned char, 128> letters;
+  std::iota(letters.begin(), letters.end(), 0);
+  limit = std::min<int>(limit, letters.size());
+  std::partial_sort(letters.begin(), letters.begin() + limit, letters.end(),
+                    [&counts](unsigned char a, unsigned char b) {
+                      return counts[a] > counts[b];
+                    });
+
+  ++m_round;
+  ++m_stats.rounds;
+  m_varnamHandle = varnamHandle;
+  m_cache = cache;
+  m_deadline = std::chrono::steady_clock::now() + budget;
+  m_prefetched.clear();
+  for (int i = limit - 1; i >= 0; i--) {
+    if (counts[letters[i]] == 0) {
+      continue;
+    }
+    auto next = input;
+    next.push_back(static_cast<char>(letters[i]));
+    if (!cache->contains(next)) {
+      m_pending.push_back(std::move(next));
+    }
+  }
+  submitNext();
+}
+
+void VarnamPrefetcher::stop() {
+  if (m_pending.empty() && !m_cache) {
+    return;
+  }
+  m_transliterator->cancel(this);
+  m_pending.clear();
+  m_cache = nullptr;
+  ++m_round;
+}
+
+void VarnamPrefetcher::recordLookup(const std::string &input) {
+  if (m_prefetched.empty()) {
+    return;
+  }
+  if (std::find(m_prefetched.begin(), m_prefetched.end(), input) !=
+      m_prefetched.end()) {
+    ++m_stats.hits;
+  } else {
+    ++m_stats.misses;
+  }
+  m_prefetched.clear();
+}
+
+void VarnamPrefetcher::submitNext() {
+  if (m_pending.empty() ||
+      std::chrono::steady_clock::now() >= m_deadline) {
+    m_pending.clear();
+    m_cache = nullptr;
+    return;
+  }
+  auto input = std::move(m_pending.back());
+  m_pending.pop_back();
+  ++m_stats.issued;
+  auto cache = m_cache;
+  auto epoch = cache->epoch();
+  m_transliterator->submit(
+      this, m_varnamHandle, m_round, std::move(input),
+      [this, cache, epoch](uint64_t round, const std::string &input,
+                           std::vector<std::string> result) {
+        // results of a stopped round are still right for their input, the
+        // epoch drops those from before an invalidation
+        cache->insert(input, result, epoch);
+        ++m_stats.completed;
+        if (round != m_round) {
+          return;
+        }
+        m_prefetched.push_back(input);
+        submitNext();
+      });
+}
+
+} // namespace fcitx
@@ -0,0 +1,77 @@
+#ifndef _FCITX5_VARNAM_PREFETCHER_H_
+#define _FCITX5_VARNAM_PREFETCHER_H_
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fcitx {
+
+class VarnamResultCache;
+class VarnamTransliterator;
+
+// Looks up the most likely one letter extensions of the input in the
+// background while the user is not typing, so the next key hits the result
+// cache. Letters are ranked by how often they were typed with the scheme.
+// The lookups go through a background transliterator, keystrokes of other
+// input contexts run before them and the next key aborts them. Only used
+// from the fcitx main thread.
+class VarnamPrefetcher {
+public:
+  struct Stats {
+    uint64_t rounds;
+    uint64_t issued;
+    uint64_t completed;
+    // next lookups that were / were not among the prefetched inputs
+    uint64_t hits;
+    uint64_t misses;
+  };
+
+  VarnamPrefetcher(VarnamTransliterator *transliterator);
+
+  ~VarnamPrefetcher();
+
+  // count a letter typed with scheme
+  void observe(const std::string &scheme, char letter);
+
+  // Prefetch up to limit extensions of input into cache, giving up once
+  // budget has passed. Stops the previous round.
+  void start(const std::string &scheme, int varnamHandle,
+             VarnamResultCache *cache, const std::string &input, int limit,
+             std::chrono::milliseconds budget);
+
+  // abort the running round, called as soon as a real key arrives
+  void stop();
+
+  // account a real lookup of input against the last round
+  void recordLookup(const std::string &input);
+
+  const Stats &stats() const { return m_stats; }
+
+private:
+  using Frequencies = std::array<uint32_t, 128>;
+
+  VarnamTransliterator *m_transliterator;
+  std::unordered_map<std::string, Frequencies> m_frequencies;
+
+  // state of the current round, m_pending holds the most likely input last
+  uint64_t m_round = 0;
+  int m_varnamHandle = 0;
+  VarnamResultCache *m_cache = nullptr;
+  std::chrono::steady_clock::time_point m_deadline;
+  std::vector<std::string> m_pending;
+  std::vector<std::string> m_prefetched;
+
+  Stats m_stats{};
+
+  Frequencies &frequencies(const std::string &scheme);
+
+  void submitNext();
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_PREFETCHER_H_
@@ -0,0 +1,11 @@
+#ifndef _FCITX5_VARNAM_PUBLIC_H_
+#define _FCITX5_VARNAM_PUBLIC_H_
+
+#include <fcitx/addoninstance.h>
+
+#include <string>
+
+// Per scheme latency summary of the key path stages, one line per stage
+FCITX_ADDON_DECLARE_FUNCTION(VarnamEngine, latencySummary, std::string());
+
+#endif // _FCITX5_VARNAM_PUBLIC_H_
@@ -0,0 +1,73 @@
+#include "varnam_punctuation.h"
+#include "varnam_transliterator.h"
+#include "varnam_utils.h"
+
+extern "C" {
+#include <libgovarnam/libgovarnam.h>
+}
+
+namespace fcitx {
+
+namespace {
+
+// every key isWordBreak() may accept
+constexpr FcitxKeySym WordBreakKeys[] = {
+    FcitxKey_space,      FcitxKey_comma,     FcitxKey_period,
+    FcitxKey_question,   FcitxKey_exclam,    FcitxKey_parenleft,
+    FcitxKey_parenright, FcitxKey_semicolon, FcitxKey_apostrophe,
+    FcitxKey_quotedbl,
+};
+
+const std::string EmptyText;
+
+} // namespace
+
+void VarnamPunctuationTable::build(int varnamHandle, bool indic,
+                                   bool inscript) {
+  if (m_built && m_varnamHandle == varnamHandle && m_indic == indic &&
+      m_inscript == inscript) {
+    return;
+  }
+  m_entries.clear();
+  for (auto key : WordBreakKeys) {
+    if (!fcitx::isWordBreak(key, inscript)) {
+      continue;
+    }
+    std::string text = getWordBreakChar(key, inscript);
+    if (indic && varnamHandle > 0 && key != FcitxKey_space) {
+      std::vector<std::string> punctuation;
+      int rv = VarnamTransliterator::transliterate(varnamHandle, text,
+                                                   punctuation);
+      if (rv == VARNAM_SUCCESS && !punctuation.empty()) {
+        text = std::move(punctuation.front());
+      }
+    }
+    m_entries.push_back(Entry{key, std::move(text)});
+  }
+  m_varnamHandle = varnamHandle;
+  m_indic = indic;
+  m_inscript = inscript;
+  m_built = true;
+}
+
+void VarnamPunctuationTable::clear() {
+  m_entries.clear();
+  m_built = false;
+}
+
+const std::string &VarnamPunctuationTable::text(FcitxKeySym key) const {
+  const auto *entry = find(key);
+  return entry ? entry->text : EmptyText;
+}
+
+const VarnamPunctuationTable::Entry *
+VarnamPunctuationTable::find(FcitxKeySym key) const {
+  for (const auto &entry : m_entries) {
+    if (entry.key == key) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace fcitx
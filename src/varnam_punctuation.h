@@ -0,0 +1,46 @@
+#ifndef _FCITX5_VARNAM_PUNCTUATION_H_
+#define _FCITX5_VARNAM_PUNCTUATION_H_
+
+#include <fcitx-utils/key.h>
+
+#include <string>
+#include <vector>
+
+namespace fcitx {
+
+// Word break keys of a scheme and the text each of them commits. With
+// Indic punctuation the text is what the scheme's tokenizer makes of the
+// key, looked up once when the table is built instead of on every commit.
+class VarnamPunctuationTable {
+public:
+  // Look up the word break keys on varnamHandle, or use the plain
+  // characters when indic is false. Does nothing when the table was
+  // already built with the same arguments.
+  void build(int varnamHandle, bool indic, bool inscript);
+
+  // forget the table, the next build() looks everything up again
+  void clear();
+
+  bool isWordBreak(FcitxKeySym key) const { return find(key) != nullptr; }
+
+  // text committed after the word for key, empty if key is no word break
+  const std::string &text(FcitxKeySym key) const;
+
+private:
+  struct Entry {
+    FcitxKeySym key;
+    std::string text;
+  };
+
+  std::vector<Entry> m_entries;
+  int m_varnamHandle = 0;
+  bool m_indic = false;
+  bool m_inscript = false;
+  bool m_built = false;
+
+  const Entry *find(FcitxKeySym key) const;
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_PUNCTUATION_H_
@@ -0,0 +1,147 @@
+#include "varnam_scheme_list.h"
+#include "varnam_utils.h"
+
+#include <fcitx-utils/fs.h>
+#include <fcitx-utils/standardpath.h>
+#include <fcitx-utils/stringutils.h>
+
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+namespace fcitx {
+
+namespace {
+
+constexpr char SchemeListFile[] = "varnam/schemes";
+
+// bumped when build() changes what it lists, so old caches are rebuilt
+constexpr int SchemeListVersion = 2;
+
+// InScript layouts have icons of their own, when they are installed
+std::string schemeIcon(const VarnamSchemeInfo &scheme) {
+  std::string icon = stringutils::concat("varnam-", scheme.langCode);
+  if (scheme.identifier.find(INSCRIPT) != std::string::npos) {
+    std::string inscriptIcon = stringutils::concat(icon, "-", INSCRIPT);
+    if (!StandardPath::global()
+             .locate(StandardPath::Type::Data,
+                     stringutils::concat("icons/hicolor/48x48/apps/",
+                                         inscriptIcon, ".png"))
+             .empty()) {
+      return inscriptIcon;
+    }
+  }
+  return icon;
+}
+
+} // namespace
+
+VarnamSchemeList::VarnamSchemeList(Instance *instance)
+    : m_instance(instance), m_alive(std::make_shared<bool>(true)) {}
+
+VarnamSchemeList::~VarnamSchemeList() {
+  m_alive.reset();
+  if (m_refreshThread.joinable()) {
+    m_refreshThread.join();
+  }
+}
+
+std::string VarnamSchemeList::cacheKey() {
+  auto backend = VarnamBackend::get();
+  std::ostringstream key;
+  key << SchemeListVersion << ";" << backend->version();
+  for (const auto &dir : backend->schemeDirectories()) {
+    struct stat st;
+    key << ";" << dir << ":";
+    if (stat(dir.c_str(), &st) == 0) {
+      key << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec;
+    }
+  }
+  return key.str();
+}
+
+bool VarnamSchemeList::load(std::string &key,
+                            std::vector<VarnamSchemeInfo> &schemes) {
+  std::ifstream file(stringutils::concat(
+      StandardPath::global().userDirectory(StandardPath::Type::PkgData), "/",
+      SchemeListFile));
+  if (!std::getline(file, key)) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    VarnamSchemeInfo scheme;
+    if (std::getline(fields, scheme.identifier, '\t') &&
+        std::getline(fields, scheme.displayName, '\t') &&
+        std::getline(fields, scheme.langCode, '\t') &&
+        std::getline(fields, scheme.icon)) {
+      schemes.push_back(std::move(scheme));
+    }
+  }
+  return true;
+}
+
+void VarnamSchemeList::save(const std::string &key,
+                            const std::vector<VarnamSchemeInfo> &schemes) {
+  std::string content = stringutils::concat(key, "\n");
+  for (const auto &scheme : schemes) {
+    content += stringutils::concat(scheme.identifier, "\t", scheme.displayName,
+                                   "\t", scheme.langCode, "\t", scheme.icon,
+                                   "\n");
+  }
+  StandardPath::global().safeSave(
+      StandardPath::Type::PkgData, SchemeListFile, [&content](int fd) {
+        return fs::safeWrite(fd, content.data(), content.size()) ==
+               static_cast<ssize_t>(content.size());
+      });
+}
+
+std::vector<VarnamSchemeInfo> VarnamSchemeList::build() {
+  auto schemes = VarnamBackend::get()->schemes();
+  for (auto &scheme : schemes) {
+    scheme.icon = schemeIcon(scheme);
+  }
+  return schemes;
+}
+
+std::vector<VarnamSchemeInfo> VarnamSchemeList::schemes() {
+  std::string key;
+  std::vector<VarnamSchemeInfo> schemes;
+  if (!load(key, schemes)) {
+    schemes = build();
+    save(cacheKey(), schemes);
+    return schemes;
+  }
+  if (key != cacheKey()) {
+#ifdef DEBUG_MODE
+    VARNAM_INFO() << "scheme list cache is outdated";
+#endif
+    refresh(schemes);
+  }
+  return schemes;
+}
+
+void VarnamSchemeList::refresh(std::vector<VarnamSchemeInfo> cached) {
+  if (m_refreshThread.joinable()) {
+    m_refreshThread.join();
+  }
+  std::weak_ptr<bool> alive = m_alive;
+  m_refreshThread = std::thread([this, alive, cached = std::move(cached)]() {
+    auto key = cacheKey();
+    auto schemes = build();
+    save(key, schemes);
+    if (schemes == cached) {
+      return;
+    }
+    m_instance->eventDispatcher().schedule([this, alive]() {
+      if (alive.expired()) {
+        return;
+      }
+      // let fcitx list the input methods again, now from the new cache
+      m_instance->refresh();
+    });
+  });
+}
+
+} // namespace fcitx
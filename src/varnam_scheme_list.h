@@ -0,0 +1,52 @@
+#ifndef _FCITX5_VARNAM_SCHEME_LIST_H_
+#define _FCITX5_VARNAM_SCHEME_LIST_H_
+
+#include "varnam_backend.h"
+
+#include <fcitx/instance.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fcitx {
+
+// Scheme metadata of the backend, cached in the fcitx user data dir so
+// listing the input methods at startup only reads one small file. The
+// cache is keyed by the engine version and the modification times of the
+// scheme directories.
+class VarnamSchemeList {
+public:
+  VarnamSchemeList(Instance *instance);
+
+  ~VarnamSchemeList();
+
+  // Cached schemes. Without a cache file they are read from the backend
+  // right away. An outdated cache is still returned, and rebuilt in the
+  // background; the input method list is reloaded if the schemes changed.
+  std::vector<VarnamSchemeInfo> schemes();
+
+private:
+  Instance *m_instance;
+  std::shared_ptr<bool> m_alive;
+  std::thread m_refreshThread;
+
+  // engine version and scheme directory mtimes the cache was built for
+  static std::string cacheKey();
+
+  // read the cache file, returns false if there is none
+  static bool load(std::string &key, std::vector<VarnamSchemeInfo> &schemes);
+
+  static void save(const std::string &key,
+                   const std::vector<VarnamSchemeInfo> &schemes);
+
+  // scheme list of the backend with icon names filled in
+  static std::vector<VarnamSchemeInfo> build();
+
+  void refresh(std::vector<VarnamSchemeInfo> cached);
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_SCHEME_LIST_H_
@@ -10,73 +10,333 @@
 #include <fcitx-utils/utf8.h>
 #include <fcitx/inputpanel.h>
 
-#include <iterator>
-#include <limits>
-#include <sstream>
+#include <algorithm>
+#include <chrono>
 #include <string>
-#include <thread>
+#include <string_view>
+
+extern "C" {
+#include <libgovarnam/libgovarnam.h>
+}
 
 namespace fcitx {
 
+namespace {
+
+// append the tokenizer suggestions missing from the dictionary ones
+void mergeCandidates(std::vector<std::string> &dictionary,
+                     const std::vector<std::string> &tokenizer) {
+  size_t dictionarySize = dictionary.size();
+  for (const auto &word : tokenizer) {
+    auto end = dictionary.begin() + dictionarySize;
+    if (std::find(dictionary.begin(), end, word) == end) {
+      dictionary.push_back(word);
+    }
+  }
+}
+
+} // namespace
+
 VarnamState::VarnamState(VarnamEngine *engine, InputContext &ic)
-    : m_ic(&ic), m_engine(engine) {
-  m_result = nullptr;
-  m_cursor = std::numeric_limits<unsigned int>::max();
+    : m_ic(&ic), m_engine(engine), m_config(engine->config()) {
+  m_varnamHandle = 0;
+  m_tokenizerHandle = 0;
+  m_resultCache = nullptr;
+  m_punctuation = nullptr;
+  m_numbers = nullptr;
+  m_inscript = nullptr;
+  m_stats = nullptr;
+  m_generation = 0;
+  m_resultGeneration = 0;
   m_candidateSelected = 0;
   m_lastTypedCharIsDigit = false;
+  m_awaitingFirstCandidate = false;
+  m_schemeLoaded = false;
+  m_firstKeyWarm = false;
 }
 
-VarnamState::~VarnamState() {
-  if (m_result) {
-    varray_free(m_result, nullptr);
-  }
+VarnamState::~VarnamState() { m_engine->transliterator()->cancel(this); }
+
+void VarnamState::setScheme(const std::string &scheme, int varnamHandle,
+                            int tokenizerHandle,
+                            VarnamResultCache *resultCache,
+                            const VarnamPunctuationTable *punctuation,
+                            const VarnamNumberTable *numbers,
+                            const VarnamInscriptTable *inscript,
+                            VarnamSchemeStats *stats,
+                            std::shared_ptr<const VarnamEngineConfig> config) {
+  m_scheme = scheme;
+  m_varnamHandle = varnamHandle;
+  m_tokenizerHandle = tokenizerHandle;
+  m_resultCache = resultCache;
+  m_punctuation = punctuation;
+  m_numbers = numbers;
+  m_inscript = inscript;
+  m_lastUsed = std::chrono::steady_clock::now();
+  m_awaitingFirstCandidate = true;
+  m_firstKeyTime = m_lastUsed;
+  m_schemeLoaded = false;
+  m_firstKeyWarm = false;
+  m_stats = stats;
+  m_config = std::move(config);
 }
 
-std::string VarnamState::bufferToString() {
-  std::string str;
-  std::stringstream strstream;
-  for (auto ch : m_buffer) {
-    strstream << ch;
+size_t VarnamState::resultBytes() const {
+  size_t bytes = m_result.capacity() * sizeof(std::string);
+  for (const auto &word : m_result) {
+    // short strings live inside the std::string itself
+    if (word.capacity() >= sizeof(std::string)) {
+      bytes += word.capacity() + 1;
+    }
   }
-  str.assign(strstream.str());
-  return str;
+  return bytes;
 }
 
-void VarnamState::updatePreeditCursor() {
-  if (m_cursor > m_preedit.textLength()) {
-    m_cursor = m_preedit.textLength();
+void VarnamState::setPreedit() {
+  if (!m_preedit) {
+    m_preedit = std::make_unique<Text>();
   }
-  m_preedit.setCursor(m_cursor);
+  m_preedit->clear();
+  m_preedit->append(m_buffer.text(), TextFormatFlag::HighLight);
+  m_preedit->setCursor(m_buffer.cursorByte());
   if (m_ic->capabilityFlags().test(CapabilityFlag::Preedit)) {
-    m_ic->inputPanel().setClientPreedit(m_preedit);
+    m_ic->inputPanel().setClientPreedit(*m_preedit);
   } else {
-    m_ic->inputPanel().setPreedit(m_preedit);
+    m_ic->inputPanel().setPreedit(*m_preedit);
   }
   m_ic->updatePreedit();
+}
+
+size_t VarnamState::memoryBytes() const {
+  size_t bytes = sizeof(*this) + m_scheme.capacity() + m_buffer.capacity() +
+                 resultBytes();
+  if (m_preedit) {
+    bytes += sizeof(Text) + m_buffer.size();
+  }
+  return bytes;
+}
+
+bool VarnamState::releaseBuffers() {
+  if (!m_buffer.empty()) {
+    return false;
+  }
+  cancelBurst();
+  m_burstTimer.reset();
+  m_preedit.reset();
+  m_buffer.release();
+  std::vector<std::string>().swap(m_result);
+  return true;
+}
+
+void VarnamState::updatePreeditCursor() {
+  VarnamStageTimer timer(m_stats, VarnamStage::PreeditUpdate);
+  setPreedit();
   m_ic->updateUserInterface(UserInterfaceComponent::InputPanel);
 }
 
+bool VarnamState::deferTransliteration() {
+  auto now = std::chrono::steady_clock::now();
+  auto last = m_lastKeyTime;
+  m_lastKeyTime = now;
+  auto delay = std::chrono::milliseconds(m_config->keyBurstDelay.value());
+  if (delay.count() == 0) {
+    return false;
+  }
+  if (m_burstTimer && m_burstTimer->isEnabled()) {
+    // the timer armed by the first key of the burst picks this one up too
+    return true;
+  }
+  if (now - last > delay) {
+    // normal typing speed, keep transliterating every key right away
+    return false;
+  }
+  // armed at most delay after the key, so no key waits longer than that
+  uint64_t usec =
+      std::chrono::duration_cast<std::chrono::microseconds>(delay).count();
+  if (!m_burstTimer) {
+    m_burstTimer = m_engine->instance()->eventLoop().addTimeEvent(
+        CLOCK_MONOTONIC, fcitx::now(CLOCK_MONOTONIC) + usec, 0,
+        [this](EventSourceTime *, uint64_t) {
+          getVarnamResult();
+          updateUI();
+          return true;
+        });
+  } else {
+    m_burstTimer->setTime(fcitx::now(CLOCK_MONOTONIC) + usec);
+  }
+  m_burstTimer->setOneShot();
+  // the shown candidates no longer belong to the buffer
+  ++m_generation;
+  m_engine->transliterator()->cancel(this);
+  return true;
+}
+
+void VarnamState::cancelBurst() {
+  if (m_burstTimer) {
+    m_burstTimer->setEnabled(false);
+  }
+}
+
 bool VarnamState::getVarnamResult() {
-  std::string preedit = bufferToString();
+  cancelBurst();
+  const std::string &preedit = m_buffer.text();
 #ifdef DEBUG_MODE
   VARNAM_INFO() << "transliterate preedit:" << preedit;
 #endif
-  int rv = VARNAM_SUCCESS;
-  rv = varnam_transliterate(m_engine->getVarnamHandle(), 1,
-                            (char *)preedit.c_str(), &m_result);
+  m_engine->prefetcher()->recordLookup(preedit);
+  ++m_generation;
+  if (m_numbers && m_numbers->convert(preedit, m_result)) {
+    // numbers only need the digit table
+    m_engine->transliterator()->cancel(this);
+    m_resultGeneration = m_generation;
+    return true;
+  }
+  auto cache = m_resultCache;
+  if (auto cached = cache->find(preedit)) {
+    m_engine->transliterator()->cancel(this);
+    m_result = *cached;
+    m_resultGeneration = m_generation;
+    return true;
+  }
+  if (m_tokenizerHandle > 0 && m_config->asyncTransliteration.value()) {
+    // phase one: tokenizer suggestions are cheap enough for the key path
+    int rv = VarnamTransliterator::transliterate(m_tokenizerHandle, preedit,
+                                                 m_result, m_stats);
+    m_resultGeneration = m_generation;
+    if (rv != VARNAM_SUCCESS) {
+      VARNAM_WARN() << "varnam transliterate failed! err:" << rv;
+    }
+    // phase two: dictionary suggestions are merged in when they arrive
+    m_dictionaryDeadline = std::chrono::steady_clock::now() +
+                           std::chrono::milliseconds(
+                               m_config->latencyBudget.value());
+    auto ref = m_ic->watch();
+    auto factory = m_engine->factory();
+    m_engine->transliterator()->submit(
+        this, m_varnamHandle, m_generation, preedit,
+        [ref, factory](uint64_t generation, const std::string &input,
+                       std::vector<std::string> result) {
+          auto ic = ref.get();
+          if (!ic) {
+            return;
+          }
+          ic->propertyFor(factory)->onDictionaryResult(generation, input,
+                                                       std::move(result));
+        },
+        m_stats);
+    return rv == VARNAM_SUCCESS;
+  }
+  if (m_config->asyncTransliteration.value()) {
+    auto ref = m_ic->watch();
+    auto factory = m_engine->factory();
+    auto epoch = cache->epoch();
+    m_engine->transliterator()->submit(
+        this, m_varnamHandle, m_generation, preedit,
+        [ref, factory, cache, epoch](uint64_t generation,
+                                     const std::string &input,
+                                     std::vector<std::string> result) {
+          // stale results are still valid for their own input, unless the
+          // cache was invalidated while they were looked up
+          cache->insert(input, result, epoch);
+          auto ic = ref.get();
+          if (!ic) {
+            return;
+          }
+          ic->propertyFor(factory)->onVarnamResult(generation,
+                                                   std::move(result));
+        },
+        m_stats);
+    return true;
+  }
+  int rv = transliterateNow(preedit, m_result);
+  m_resultGeneration = m_generation;
   if (rv != VARNAM_SUCCESS) {
     VARNAM_WARN() << "varnam transliterate failed! err:" << rv;
     return false;
   }
+  cache->insert(preedit, m_result);
   return true;
 }
 
+int VarnamState::transliterateNow(const std::string &input,
+                                  std::vector<std::string> &result) {
+  if (m_numbers && m_numbers->convert(input, result)) {
+    return VARNAM_SUCCESS;
+  }
+  int rv = VarnamTransliterator::transliterate(m_varnamHandle, input, result,
+                                               m_stats);
+  if (rv != VARNAM_SUCCESS || m_tokenizerHandle <= 0) {
+    return rv;
+  }
+  std::vector<std::string> tokenizer;
+  rv = VarnamTransliterator::transliterate(m_tokenizerHandle, input, tokenizer,
+                                           m_stats);
+  mergeCandidates(result, tokenizer);
+  return rv;
+}
+
+void VarnamState::onDictionaryResult(uint64_t generation,
+                                     const std::string &input,
+                                     std::vector<std::string> result) {
+  if (generation != m_generation) {
+    // the tokenizer candidates of that input are gone, nothing to merge
+    return;
+  }
+  mergeCandidates(result, m_result);
+  m_resultCache->insert(input, result);
+  auto budget = m_config->latencyBudget.value();
+  if (budget > 0 && std::chrono::steady_clock::now() > m_dictionaryDeadline) {
+    // over the latency budget, keep showing the tokenizer candidates only
+    return;
+  }
+  // keep the word the user moved the cursor to selected across the merge
+  std::string selected;
+  auto candidates = std::dynamic_pointer_cast<VarnamCandidateList>(
+      m_ic->inputPanel().candidateList());
+  if (candidates && candidates->globalCursorIndex() > 0) {
+    selected = candidates->text(candidates->globalCursorIndex());
+  }
+  m_result = std::move(result);
+  updateUI(selected);
+}
+
+void VarnamState::flushPendingResult() {
+  if (!isResultPending() || m_buffer.empty()) {
+    return;
+  }
+  cancelBurst();
+  m_engine->transliterator()->cancel(this);
+  const std::string &preedit = m_buffer.text();
+  int rv = transliterateNow(preedit, m_result);
+  m_resultGeneration = m_generation;
+  if (rv != VARNAM_SUCCESS) {
+    VARNAM_WARN() << "varnam transliterate failed! err:" << rv;
+  } else {
+    m_resultCache->insert(preedit, m_result);
+  }
+  updateUI();
+}
+
+void VarnamState::onVarnamResult(uint64_t generation,
+                                 std::vector<std::string> result) {
+  if (generation != m_generation) {
+#ifdef DEBUG_MODE
+    VARNAM_INFO() << "drop stale result, generation:" << generation;
+#endif
+    return;
+  }
+  m_result = std::move(result);
+  m_resultGeneration = generation;
+  updateUI();
+}
+
 void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
 #ifdef DEBUG_MODE
   VARNAM_INFO() << "rcvd key:"
                 << keyEvent.key().toString(KeyStringFormat::Localized);
 #endif
   auto key = keyEvent.key();
+  m_lastUsed = std::chrono::steady_clock::now();
 
   // filter modififer keys
   if (key.checkKeyList(keyListToFilter)) {
@@ -84,8 +344,20 @@ void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
     return;
   }
 
+  if (m_inscript) {
+    processInscriptKey(keyEvent);
+    return;
+  }
+
+  if (m_awaitingFirstCandidate && m_buffer.empty()) {
+    m_firstKeyTime = m_lastUsed;
+    m_firstKeyWarm = m_engine->warmup()->finished(m_varnamHandle);
+  }
+
   // handle candidate selection through index key
-  if (!m_buffer.empty() && key.isDigit() && !m_lastTypedCharIsDigit) {
+  if (!m_buffer.empty() && key.isDigit() && !m_lastTypedCharIsDigit &&
+      !VarnamNumberTable::isNumber(m_buffer.text())) {
+    flushPendingResult();
     auto idx = key.keyListIndex(selectionKeys);
     selectCandidate(idx);
     commitText(key.sym());
@@ -100,9 +372,16 @@ void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
       return;
     }
     if (key.sym() == FcitxKey_Delete) {
+      // the shown list must belong to the buffer before a word is picked
+      flushPendingResult();
       auto candidates = m_ic->inputPanel().candidateList();
+      int index = m_candidateSelected;
+      if (!candidates || index < 0 || index >= candidates->size()) {
+        keyEvent.filter();
+        return;
+      }
       std::string wordToUnlearn(
-          candidates->candidate(m_candidateSelected)
+          candidates->candidate(index)
               .text()
               .toStringForCommit()); // TODO try unique_ptr<char[]>
       if (wordToUnlearn.empty()) {
@@ -112,10 +391,9 @@ void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
 #ifdef DEBUG_MODE
       VARNAM_INFO() << "unlearn word:" << wordToUnlearn;
 #endif
-      std::thread unlearnThread(varnam_unlearn_word,
-                                m_engine->getVarnamHandle(),
-                                std::move(wordToUnlearn));
-      unlearnThread.detach();
+      m_resultCache->removeWord(wordToUnlearn);
+      m_engine->learner()->unlearn(m_scheme, m_varnamHandle,
+                                   std::move(wordToUnlearn), m_stats);
       reset();
       updateUI();
       keyEvent.filterAndAccept();
@@ -124,7 +402,7 @@ void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
     keyEvent.filter();
     return;
   }
-  if (key.checkKeyList(m_engine->getConfig()->nextCandidate.value())) {
+  if (key.checkKeyList(m_config->nextCandidate.value())) {
     if (m_buffer.empty()) {
       keyEvent.filter();
       return;
@@ -133,7 +411,7 @@ void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
     keyEvent.filterAndAccept();
     return;
   }
-  if (key.checkKeyList(m_engine->getConfig()->prevCandidate.value())) {
+  if (key.checkKeyList(m_config->prevCandidate.value())) {
     if (m_buffer.empty()) {
       keyEvent.filter();
       return;
@@ -142,7 +420,7 @@ void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
     keyEvent.filterAndAccept();
     return;
   }
-  if (key.checkKeyList(m_engine->getConfig()->nextPage.value())) {
+  if (key.checkKeyList(m_config->nextPage.value())) {
     if (m_buffer.empty()) {
       keyEvent.filter();
       return;
@@ -151,7 +429,7 @@ void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
     keyEvent.filterAndAccept();
     return;
   }
-  if (key.checkKeyList(m_engine->getConfig()->prevPage.value())) {
+  if (key.checkKeyList(m_config->prevPage.value())) {
     if (m_buffer.empty()) {
       keyEvent.filter();
       return;
@@ -161,9 +439,6 @@ void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
     return;
   }
 
-  auto iterator = m_buffer.begin();
-  iterator += m_cursor;
-
   switch (key.sym()) {
   case FcitxKey_Escape:
   case FcitxKey_space:
@@ -178,24 +453,20 @@ void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
     keyEvent.filterAndAccept();
     return;
   case FcitxKey_Left:
-    if (m_preedit.empty()) {
+    if (m_buffer.empty()) {
       keyEvent.filter();
       return;
     }
-    if (m_cursor > 0) {
-      --m_cursor;
-    }
+    m_buffer.moveLeft();
     updatePreeditCursor();
     keyEvent.filterAndAccept();
     return;
   case FcitxKey_Right:
-    if (m_preedit.empty()) {
+    if (m_buffer.empty()) {
       keyEvent.filter();
       return;
     }
-    if (m_cursor < (m_buffer.size())) {
-      ++m_cursor;
-    }
+    m_buffer.moveRight();
     updatePreeditCursor();
     keyEvent.filterAndAccept();
     return;
@@ -208,10 +479,7 @@ void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
       keyEvent.filter();
       return;
     }
-    if (m_cursor > 0) {
-      m_buffer.erase(--iterator);
-      --m_cursor;
-    }
+    m_buffer.erasePrevious();
     getVarnamResult();
     updateUI();
     keyEvent.filterAndAccept();
@@ -221,9 +489,7 @@ void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
       keyEvent.filter();
       return;
     }
-    if (m_cursor < m_buffer.size()) {
-      m_buffer.erase(iterator);
-    }
+    m_buffer.eraseNext();
     getVarnamResult();
     updateUI();
     keyEvent.filterAndAccept();
@@ -233,7 +499,7 @@ void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
       keyEvent.filter();
       return;
     }
-    m_cursor = 0;
+    m_buffer.moveToStart();
     updatePreeditCursor();
     keyEvent.filterAndAccept();
     return;
@@ -242,7 +508,7 @@ void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
       keyEvent.filter();
       return;
     }
-    m_cursor = m_preedit.textLength();
+    m_buffer.moveToEnd();
     updatePreeditCursor();
     keyEvent.filterAndAccept();
     return;
@@ -256,7 +522,12 @@ void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
     m_lastTypedCharIsDigit = false;
   }
 
-  if (isWordBreak(keyEvent.key().sym())) {
+  // separators inside a number stay in the preedit, "3.5" is one number
+  bool continuesNumber = key.sym() < 0x80 &&
+                         VarnamNumberTable::isSeparator(key.sym()) &&
+                         VarnamNumberTable::isNumber(m_buffer.text());
+  if (!continuesNumber && m_punctuation &&
+      m_punctuation->isWordBreak(keyEvent.key().sym())) {
     commitText(keyEvent.key().sym());
     updateUI();
     keyEvent.filterAndAccept();
@@ -268,23 +539,17 @@ void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
     return;
   }
 
-  unsigned char input =
-      *(keyEvent.key().toString(KeyStringFormat::Localized).c_str());
+  char input = *(keyEvent.key().toString(KeyStringFormat::Localized).c_str());
 #ifdef DEBUG_MODE
-  VARNAM_INFO() << "cursor at:" << m_cursor;
+  VARNAM_INFO() << "cursor at:" << m_buffer.cursor();
 #endif
-  if (m_cursor >= m_buffer.size()) {
-    m_buffer.push_back(input);
-    m_cursor = m_buffer.size();
-  } else {
-    m_buffer.insert(iterator, input);
-    ++m_cursor;
-  }
-
-  if (m_result) {
-    varray_clear(m_result);
-  } else {
-    m_result = varray_init();
+  m_buffer.insert(std::string_view(&input, 1));
+  m_engine->prefetcher()->observe(m_scheme, input);
+  if (deferTransliteration()) {
+    // show the letter now, only its lookup waits for the burst to end
+    updatePreeditCursor();
+    keyEvent.filterAndAccept();
+    return;
   }
 
   getVarnamResult();
@@ -292,38 +557,46 @@ void VarnamState::processKeyEvent(KeyEvent &keyEvent) {
   keyEvent.filterAndAccept();
 }
 
-void VarnamState::setLookupTable() {
-  if (!m_result) {
-    return;
-  }
-  auto candidates = std::make_unique<VarnamCandidateList>(m_engine, m_ic);
-  candidates->setSelectionKey(selectionKeys);
-  candidates->setCursorPositionAfterPaging(
-      CursorPositionAfterPaging::ResetToFirst);
-  candidates->setPageSize(m_engine->getConfig()->pageSize.value());
-
-  int count = varray_length(m_result);
-  char preeditAppended = 0;
-  for (int i = 0; i < count; i++) {
-    if ((candidates->pageSize() == 10) &&
-        ((i + (preeditAppended ? (1 + preeditAppended) : 1)) % 10 == 0)) {
-      // TODO ;}
-      candidates->append<VarnamCandidateWord>(m_engine,
-                                              m_preedit.toString().c_str(), i);
-      ++preeditAppended;
+bool VarnamState::setLookupTable(std::string_view keepSelected) {
+  if (m_result.empty()) {
+    return false;
+  }
+  VarnamStageTimer timer(m_stats, VarnamStage::CandidateBuild);
+  bool changed = false;
+  auto candidates = std::dynamic_pointer_cast<VarnamCandidateList>(
+      m_ic->inputPanel().candidateList());
+  if (!candidates || candidates->config() != m_config.get()) {
+    // first lookup of the word or the layout changed, start a new list
+    auto list = std::make_unique<VarnamCandidateList>(m_engine, m_ic, m_config);
+    list->setSelectionKey(selectionKeys);
+    list->setPageSize(m_config->pageSize.value());
+    m_ic->inputPanel().setCandidateList(std::move(list));
+    candidates = std::dynamic_pointer_cast<VarnamCandidateList>(
+        m_ic->inputPanel().candidateList());
+    changed = true;
+  }
+
+  changed |= candidates->setCandidates(m_result, m_buffer.text());
+  int selected = keepSelected.empty() ? -1 : candidates->find(keepSelected);
+  if (selected > 0) {
+    if (selected != candidates->globalCursorIndex()) {
+      candidates->setPage(selected / candidates->pageSize());
+      candidates->setGlobalCursorIndex(selected);
+      changed = true;
     }
-    vword *word = static_cast<vword *>(varray_get(m_result, i));
-    candidates->append<VarnamCandidateWord>(m_engine, word->text,
-                                            preeditAppended ? i + 1 : i);
+    selectCandidate(candidates->cursorIndex());
+    return changed;
   }
-  if (!preeditAppended) {
-    candidates->append<VarnamCandidateWord>(
-        m_engine, m_preedit.toString().c_str(), ++count);
+  // every new input starts from the first candidate, as a fresh list would
+  if (candidates->currentPage() != 0) {
+    candidates->setPage(0);
+    changed = true;
   }
-  if (count) {
+  if (candidates->globalCursorIndex() != 0) {
     candidates->setGlobalCursorIndex(0);
-    m_ic->inputPanel().setCandidateList(std::move(candidates));
+    changed = true;
   }
+  return changed;
 }
 
 void VarnamState::updateLookupTable(const PageAction &action) {
@@ -368,44 +641,63 @@ void VarnamState::selectCandidate(int index) {
   }
 }
 
+void VarnamState::processInscriptKey(KeyEvent &keyEvent) {
+  const auto &key = keyEvent.key();
+  // shortcuts of the application go through
+  if (key.states().test(KeyState::Ctrl) || key.states().test(KeyState::Alt) ||
+      key.states().test(KeyState::Super)) {
+    keyEvent.filter();
+    return;
+  }
+  const auto *text = m_inscript->text(key.sym());
+  if (!text) {
+    keyEvent.filter();
+    return;
+  }
+  m_ic->commitString(*text);
+  keyEvent.filterAndAccept();
+}
+
 void VarnamState::commitText(const FcitxKeySym &key) {
+  flushPendingResult();
+  VarnamStageTimer timer(m_stats, VarnamStage::Commit);
   auto candidates = m_ic->inputPanel().candidateList();
   std::string stringToCommit;
   std::string wordToLearn;
-  bool isWordBreakKey = isWordBreak(key);
-  bool enableIndicPunctuation =
-      m_engine->getConfig()->enablePunctuation.value();
+  bool isWordBreakKey = m_punctuation && m_punctuation->isWordBreak(key);
 
   if (key == FcitxKey_Escape || key == FcitxKey_0 || !candidates ||
-      candidates->size() <= 1 || !m_result || varray_is_empty(m_result)) {
-    stringToCommit.assign(m_preedit.toStringForCommit());
+      candidates->size() <= 1 || m_result.empty()) {
+    stringToCommit.assign(m_buffer.text());
     m_candidateSelected = 0;
   } else if ((candidates->cursorIndex() <= 0) && !m_candidateSelected) {
-    vword *first_result = static_cast<vword *>(varray_get(m_result, 0));
-    if (first_result) {
-      stringToCommit.assign(first_result->text);
-      m_candidateSelected = 1;
-    }
+    stringToCommit.assign(m_result.front());
+    m_candidateSelected = 1;
   } else {
     stringToCommit.assign(
         candidates->candidate(m_candidateSelected).text().toStringForCommit());
   }
   wordToLearn = stringToCommit;
 
+  // a separator ending a number was kept in the preedit in case more
+  // digits follow, it is the scheme's punctuation after all
+  bool isNumber = VarnamNumberTable::isNumber(m_buffer.text());
+  if (isNumber && m_candidateSelected && m_punctuation &&
+      !stringToCommit.empty()) {
+    auto separator = static_cast<FcitxKeySym>(
+        static_cast<unsigned char>(stringToCommit.back()));
+    if (m_punctuation->isWordBreak(separator)) {
+      stringToCommit.pop_back();
+      stringToCommit.append(m_punctuation->text(separator));
+    }
+  }
+
   if (isWordBreakKey) {
-    if (enableIndicPunctuation && m_candidateSelected) {
-      m_buffer.clear();
-      m_buffer.push_back(getWordBreakChar(key)[0]);
-      if (getVarnamResult() && m_result && varray_length(m_result) > 0) {
-        vword *m_resultword = static_cast<vword *>(varray_get(m_result, 0));
-        if (m_resultword) {
-          stringToCommit =
-              stringutils::concat(stringToCommit, m_resultword->text);
-        }
-      }
+    // the scheme's punctuation only follows a transliterated word
+    if (m_candidateSelected) {
+      stringToCommit.append(m_punctuation->text(key));
     } else {
-      stringToCommit =
-          stringutils::concat(stringToCommit, getWordBreakChar(key));
+      stringToCommit.append(getWordBreakChar(key));
     }
   }
 
@@ -415,9 +707,9 @@ void VarnamState::commitText(const FcitxKeySym &key) {
   m_ic->commitString(stringToCommit);
 
   if (stringToCommit.empty() || !m_candidateSelected ||
-      m_lastTypedCharIsDigit ||
+      m_lastTypedCharIsDigit || isNumber ||
       m_ic->capabilityFlags().test(CapabilityFlag::PasswordOrSensitive) ||
-      !m_engine->getConfig()->shouldLearnWords.value()) {
+      !m_config->shouldLearnWords.value()) {
     reset();
     return;
   }
@@ -425,54 +717,79 @@ void VarnamState::commitText(const FcitxKeySym &key) {
 #ifdef DEBUG_MODE
   VARNAM_INFO() << "Word To Learn:" << wordToLearn;
 #endif
+  m_resultCache->invalidatePrefixes(m_buffer.text());
 
-  std::thread learnThread(varnam_learn_word, m_engine->getVarnamHandle(),
-                          std::move(wordToLearn), 0);
-  learnThread.detach();
+  m_engine->learner()->learn(m_scheme, m_varnamHandle, std::move(wordToLearn),
+                             m_buffer.text(), m_stats);
 
   reset();
 }
 
-void VarnamState::updateUI() {
-  m_ic->inputPanel().reset();
+void VarnamState::updateUI(std::string_view keepSelected) {
   if (m_buffer.empty()) {
+    m_ic->inputPanel().reset();
     m_ic->updatePreedit();
     m_ic->updateUserInterface(UserInterfaceComponent::InputPanel);
     return;
   }
-  if (m_result == nullptr) {
+  if (isResultPending()) {
+    // keep the previous candidates until the background lookup returns
+    updatePreeditCursor();
     return;
   }
-  if (varray_length(m_result) == 0x00) {
+  if (m_result.empty()) {
     return;
   }
 
-  m_preedit.clear();
-  m_preedit.append(bufferToString(), TextFormatFlag::HighLight);
-  if (m_cursor > m_preedit.textLength()) {
-    m_cursor = m_preedit.textLength();
+  // the candidate list is kept in the panel and updated in place
+  bool clientPreedit = m_ic->capabilityFlags().test(CapabilityFlag::Preedit);
+  {
+    VarnamStageTimer timer(m_stats, VarnamStage::PreeditUpdate);
+    setPreedit();
+  }
+  // with client side preedit the panel only shows candidates, so leave it
+  // alone when they are unchanged
+  if (setLookupTable(keepSelected) || !clientPreedit) {
+    m_ic->updateUserInterface(UserInterfaceComponent::InputPanel);
   }
-  m_preedit.setCursor(m_cursor);
+  if (m_awaitingFirstCandidate && m_stats) {
+    auto elapsed = std::chrono::steady_clock::now() - m_firstKeyTime;
+    m_stats->record(VarnamStage::FirstCandidate, elapsed);
+    if (m_schemeLoaded) {
+      m_stats->record(m_firstKeyWarm ? VarnamStage::FirstCandidateWarm
+                                     : VarnamStage::FirstCandidateCold,
+                      elapsed);
+    }
+  }
+  m_awaitingFirstCandidate = false;
+  m_schemeLoaded = false;
+  prefetch();
+}
 
-  if (m_ic->capabilityFlags().test(CapabilityFlag::Preedit)) {
-    m_ic->inputPanel().setClientPreedit(m_preedit);
-  } else {
-    m_ic->inputPanel().setPreedit(m_preedit);
+void VarnamState::prefetch() {
+  // progressive results are merged from two handles, the cache can only be
+  // filled from the full lookup
+  if (m_tokenizerHandle > 0 || isResultPending() ||
+      m_buffer.cursorByte() != m_buffer.size() ||
+      VarnamNumberTable::isNumber(m_buffer.text())) {
+    return;
   }
-  m_ic->updatePreedit();
-  setLookupTable();
-  m_ic->updateUserInterface(UserInterfaceComponent::InputPanel);
+  m_engine->prefetcher()->start(
+      m_scheme, m_varnamHandle, m_resultCache, m_buffer.text(),
+      m_config->prefetchLimit.value(),
+      std::chrono::milliseconds(m_config->prefetchBudget.value()));
 }
 
 void VarnamState::reset() {
-  m_cursor = std::numeric_limits<unsigned int>::max();
   m_candidateSelected = 0;
   m_lastTypedCharIsDigit = false;
   m_buffer.clear();
-  m_preedit.clear();
-  if (m_result) {
-    varray_clear(m_result);
-  }
+  m_result.clear();
+  // drop any lookup still running for the discarded buffer
+  ++m_generation;
+  m_resultGeneration = m_generation;
+  m_engine->transliterator()->cancel(this);
+  cancelBurst();
 }
 
 } // namespace fcitx
\ No newline at end of file
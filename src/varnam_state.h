@@ -2,57 +2,167 @@
 #define _FCITX5_VARNAM_STATE_H
 
 #include "varnam_candidate.h"
+#include "varnam_config.h"
+#include "varnam_preedit.h"
 
+#include <fcitx-utils/event.h>
 #include <fcitx/inputcontext.h>
 #include <fcitx/text.h>
 
-extern "C" {
-#include <libgovarnam/libgovarnam.h>
-}
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace fcitx {
 
 class VarnamEngine;
+class VarnamResultCache;
+struct VarnamSchemeStats;
 
 class VarnamState : public InputContextProperty {
 
 private:
   // Private Variables
-  unsigned int m_cursor;
   char m_candidateSelected;
   bool m_lastTypedCharIsDigit;
 
   InputContext *m_ic;
   VarnamEngine *m_engine;
-  Text m_preedit;
-
-  std::vector<char> m_buffer;
-  varray *m_result;
+  // handles, result cache, word breaks and digits of the scheme active in
+  // this context, the tokenizer handle is only set for progressive candidates
+  std::string m_scheme;
+  int m_varnamHandle;
+  int m_tokenizerHandle;
+  VarnamResultCache *m_resultCache;
+  const VarnamPunctuationTable *m_punctuation;
+  const VarnamNumberTable *m_numbers;
+  // key map of InScript schemes, nullptr when keys are transliterated
+  const VarnamInscriptTable *m_inscript;
+  VarnamSchemeStats *m_stats;
+  std::shared_ptr<const VarnamEngineConfig> m_config;
+  // created on first use, contexts that never see a key hold no buffers
+  std::unique_ptr<Text> m_preedit;
+
+  VarnamPreeditBuffer m_buffer;
+  std::vector<std::string> m_result;
+
+  // bumped on every buffer edit, results for older generations are stale
+  uint64_t m_generation;
+  uint64_t m_resultGeneration;
+  // dictionary suggestions arriving after this are not shown
+  std::chrono::steady_clock::time_point m_dictionaryDeadline;
+  // transliterates the buffer once a burst of fast keys has settled
+  std::unique_ptr<EventSourceTime> m_burstTimer;
+  std::chrono::steady_clock::time_point m_lastKeyTime;
+  // last activation or key, for releasing the buffers of idle contexts
+  std::chrono::steady_clock::time_point m_lastUsed;
+  // the first word after activation, timed until its candidates show up
+  bool m_awaitingFirstCandidate;
+  std::chrono::steady_clock::time_point m_firstKeyTime;
+  // the scheme was loaded for this activation, and whether its warm-up
+  // had finished at the first key
+  bool m_schemeLoaded;
+  bool m_firstKeyWarm;
 
   // Private Methods
 
-  // convert buffer to std::string
-  std::string bufferToString();
+  // commit the text of an InScript key, there is no preedit
+  void processInscriptKey(KeyEvent &keyEvent);
 
   // generate Varnam Result
   bool getVarnamResult();
 
-  // update Preedit Cursor Position
+  // Postpone the transliteration of a key typed right after the previous
+  // one. Returns true if the burst timer will transliterate the buffer.
+  bool deferTransliteration();
+
+  // drop a postponed transliteration, the caller handles the buffer now
+  void cancelBurst();
+
+  // look up likely next inputs while the user is not typing
+  void prefetch();
+
+  // transliterate input on the calling thread, asking both handles when
+  // candidates are progressive
+  int transliterateNow(const std::string &input,
+                       std::vector<std::string> &result);
+
+  // replace a pending background result with a synchronous lookup
+  void flushPendingResult();
+
+  // check if m_result belongs to the current buffer
+  bool isResultPending() const { return m_resultGeneration != m_generation; }
+
+  // show the buffer as preedit with the cursor at its position
   void updatePreeditCursor();
 
+  // hand the buffer with its cursor to the preedit of the context
+  void setPreedit();
+
 public:
   VarnamState(VarnamEngine *, InputContext &);
 
   ~VarnamState();
 
+  // Switch to the scheme activated in this input context
+  void setScheme(const std::string &scheme, int varnamHandle,
+                 int tokenizerHandle, VarnamResultCache *resultCache,
+                 const VarnamPunctuationTable *punctuation,
+                 const VarnamNumberTable *numbers,
+                 const VarnamInscriptTable *inscript, VarnamSchemeStats *stats,
+                 std::shared_ptr<const VarnamEngineConfig> config);
+
+  // the scheme was loaded for this activation, time its first word apart
+  void setSchemeLoaded() { m_schemeLoaded = true; }
+
+  void setTokenizerHandle(int tokenizerHandle) {
+    m_tokenizerHandle = tokenizerHandle;
+  }
+
+  VarnamSchemeStats *stats() const { return m_stats; }
+
+  // heap bytes held by the transliteration result of this context
+  size_t resultBytes() const;
+
+  // bytes held by this context including its buffers
+  size_t memoryBytes() const;
+
+  std::chrono::steady_clock::time_point lastUsed() const { return m_lastUsed; }
+
+  // Free the buffers of a context that is not being typed in, they are
+  // created again on the next key. Returns false if input is pending.
+  bool releaseBuffers();
+
+  // returns true if config differs from the one in use
+  bool setConfig(const std::shared_ptr<const VarnamEngineConfig> &config) {
+    if (m_config == config) {
+      return false;
+    }
+    m_config = config;
+    return true;
+  }
+
   // Handle KeyEvents
   void processKeyEvent(KeyEvent &);
 
+  // Receive background transliteration results on the main thread
+  void onVarnamResult(uint64_t generation, std::vector<std::string> result);
+
+  // Merge background dictionary suggestions into the tokenizer candidates
+  void onDictionaryResult(uint64_t generation, const std::string &input,
+                          std::vector<std::string> result);
+
   // Commit Selected Candidate to text
   void commitText(const FcitxKeySym &key = FcitxKey_None);
 
-  // Generate Candidate List/Lookup tables
-  void setLookupTable();
+  // Generate Candidate List/Lookup tables, reusing the list already in the
+  // input panel. The cursor moves back to the first candidate unless
+  // keepSelected is still in the list. Returns true if the candidates
+  // changed.
+  bool setLookupTable(std::string_view keepSelected = {});
 
   // Update Lookup table entries
   void updateLookupTable(const PageAction &);
@@ -61,7 +171,7 @@ public:
   void selectCandidate(int);
 
   // Update Input panel
-  void updateUI();
+  void updateUI(std::string_view keepSelected = {});
 
   // Reset context properties
   void reset();
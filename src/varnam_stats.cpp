@@ -0,0 +1,92 @@
+#include "varnam_stats.h"
+
+#include <sstream>
+
+namespace fcitx {
+
+const char *varnamStageName(VarnamStage stage) {
+  switch (stage) {
+  case VarnamStage::KeyDispatch:
+    return "key_dispatch";
+  case VarnamStage::Transliterate:
+    return "transliterate";
+  case VarnamStage::CandidateBuild:
+    return "candidate_build";
+  case VarnamStage::PreeditUpdate:
+    return "preedit_update";
+  case VarnamStage::Commit:
+    return "commit";
+  case VarnamStage::Learn:
+    return "learn";
+  case VarnamStage::FirstCandidate:
+    return "first_candidate";
+  case VarnamStage::FirstCandidateCold:
+    return "first_candidate_cold";
+  case VarnamStage::FirstCandidateWarm:
+    return "first_candidate_warm";
+  }
+  return "unknown";
+}
+
+void VarnamLatencyHistogram::record(
+    std::chrono::steady_clock::duration duration) {
+  uint64_t usec =
+      std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+  size_t bucket = 0;
+  while (bucket + 1 < BucketCount && (1ULL << bucket) <= usec) {
+    ++bucket;
+  }
+  m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  m_count.fetch_add(1, std::memory_order_relaxed);
+  uint64_t max = m_max.load(std::memory_order_relaxed);
+  while (usec > max &&
+         !m_max.compare_exchange_weak(max, usec, std::memory_order_relaxed)) {
+  }
+}
+
+uint64_t VarnamLatencyHistogram::percentile(double p) const {
+  uint64_t total = count();
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t rank = static_cast<uint64_t>(p * total + 0.5);
+  uint64_t seen = 0;
+  for (size_t bucket = 0; bucket < BucketCount; bucket++) {
+    seen += m_buckets[bucket].load(std::memory_order_relaxed);
+    if (seen >= rank && seen > 0) {
+      return 1ULL << bucket;
+    }
+  }
+  return maxMicroseconds();
+}
+
+VarnamSchemeStats &VarnamStats::scheme(const std::string &scheme) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto &stats = m_schemes[scheme];
+  if (!stats) {
+    stats = std::make_unique<VarnamSchemeStats>();
+  }
+  return *stats;
+}
+
+std::string VarnamStats::summary() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::ostringstream out;
+  for (const auto &[scheme, stats] : m_schemes) {
+    for (size_t i = 0; i < VarnamStageCount; i++) {
+      const auto &histogram = stats->stages[i];
+      if (histogram.count() == 0) {
+        continue;
+      }
+      out << scheme << " " << varnamStageName(static_cast<VarnamStage>(i))
+          << " count=" << histogram.count()
+          << " p50<=" << histogram.percentile(0.50) << "us"
+          << " p95<=" << histogram.percentile(0.95) << "us"
+          << " p99<=" << histogram.percentile(0.99) << "us"
+          << " max=" << histogram.maxMicroseconds() << "us\n";
+    }
+  }
+  return out.str();
+}
+
+} // namespace fcitx
@@ -0,0 +1,104 @@
+#ifndef _FCITX5_VARNAM_STATS_H_
+#define _FCITX5_VARNAM_STATS_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace fcitx {
+
+enum class VarnamStage {
+  KeyDispatch,
+  Transliterate,
+  CandidateBuild,
+  PreeditUpdate,
+  Commit,
+  Learn,
+  // first key after activation until its candidates are shown
+  FirstCandidate,
+  // the same for the first word after the scheme was loaded, split by
+  // whether a warm-up finished before its first key
+  FirstCandidateCold,
+  FirstCandidateWarm,
+};
+
+constexpr size_t VarnamStageCount = 9;
+
+const char *varnamStageName(VarnamStage stage);
+
+// Lock free latency histogram with power of two microsecond buckets, can be
+// recorded from any thread.
+class VarnamLatencyHistogram {
+public:
+  static constexpr size_t BucketCount = 24;
+
+  void record(std::chrono::steady_clock::duration duration);
+
+  uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+
+  uint64_t maxMicroseconds() const {
+    return m_max.load(std::memory_order_relaxed);
+  }
+
+  // upper bound in microseconds of the bucket holding the p-th sample
+  uint64_t percentile(double p) const;
+
+private:
+  std::array<std::atomic<uint64_t>, BucketCount> m_buckets{};
+  std::atomic<uint64_t> m_count{0};
+  std::atomic<uint64_t> m_max{0};
+};
+
+struct VarnamSchemeStats {
+  std::array<VarnamLatencyHistogram, VarnamStageCount> stages;
+
+  void record(VarnamStage stage, std::chrono::steady_clock::duration duration) {
+    stages[static_cast<size_t>(stage)].record(duration);
+  }
+};
+
+// Latency histograms of every scheme used since the addon was loaded
+class VarnamStats {
+public:
+  // stats of scheme, the returned reference stays valid for the lifetime
+  // of this object
+  VarnamSchemeStats &scheme(const std::string &scheme);
+
+  // one line per scheme and stage with count, p50, p95, p99 and max
+  std::string summary();
+
+private:
+  std::mutex m_mutex;
+  std::map<std::string, std::unique_ptr<VarnamSchemeStats>> m_schemes;
+};
+
+// records the lifetime of the object into stats, which may be null
+class VarnamStageTimer {
+public:
+  VarnamStageTimer(VarnamSchemeStats *stats, VarnamStage stage)
+      : m_stats(stats), m_stage(stage),
+        m_start(std::chrono::steady_clock::now()) {}
+
+  ~VarnamStageTimer() {
+    if (m_stats) {
+      m_stats->record(m_stage, std::chrono::steady_clock::now() - m_start);
+    }
+  }
+
+  VarnamStageTimer(const VarnamStageTimer &) = delete;
+  VarnamStageTimer &operator=(const VarnamStageTimer &) = delete;
+
+private:
+  VarnamSchemeStats *m_stats;
+  VarnamStage m_stage;
+  std::chrono::steady_clock::time_point m_start;
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_STATS_H_
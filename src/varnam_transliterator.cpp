@@ -0,0 +1,161 @@
+#include "varnam_transliterator.h"
+#include "varnam_backend.h"
+#include "varnam_utils.h"
+
+#include <algorithm>
+
+extern "C" {
+#include <libgovarnam/libgovarnam.h>
+}
+
+namespace fcitx {
+
+std::atomic<int> VarnamTransliterator::s_nextOperation{1};
+std::atomic<uint64_t> VarnamTransliterator::s_transliterations{0};
+
+VarnamTransliterator::VarnamTransliterator(Instance *instance,
+                                           VarnamLane lane)
+    : m_instance(instance), m_lane(lane),
+      m_alive(std::make_shared<bool>(true)) {
+  m_thread = std::thread(&VarnamTransliterator::run, this);
+}
+
+VarnamTransliterator::~VarnamTransliterator() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+    m_queue.clear();
+    cancelInflight();
+  }
+  m_cond.notify_all();
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+}
+
+void VarnamTransliterator::submit(const void *owner, int varnamHandle,
+                                  uint64_t generation, std::string input,
+                                  Callback callback,
+                                  VarnamSchemeStats *stats) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.erase(std::remove_if(m_queue.begin(), m_queue.end(),
+                                 [owner](const Job &job) {
+                                   return job.owner == owner;
+                                 }),
+                  m_queue.end());
+    if (m_inflightOwner == owner) {
+      cancelInflight();
+    }
+    m_queue.push_back(Job{owner, varnamHandle, s_nextOperation++, generation,
+                          std::move(input), std::move(callback), stats});
+  }
+  m_cond.notify_one();
+}
+
+void VarnamTransliterator::cancel(const void *owner) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_queue.erase(std::remove_if(
+                    m_queue.begin(), m_queue.end(),
+                    [owner](const Job &job) { return job.owner == owner; }),
+                m_queue.end());
+  if (m_inflightOwner == owner) {
+    cancelInflight();
+  }
+}
+
+void VarnamTransliterator::drain(const std::vector<int> &handles) {
+  auto closing = [&handles](int handle) {
+    return std::find(handles.begin(), handles.end(), handle) != handles.end();
+  };
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_queue.erase(std::remove_if(m_queue.begin(), m_queue.end(),
+                               [&closing](const Job &job) {
+                                 return closing(job.varnamHandle);
+                               }),
+                m_queue.end());
+  if (m_inflightOwner != nullptr && closing(m_inflightHandle)) {
+    cancelInflight();
+  }
+  m_idleCond.wait(lock, [&] {
+    return m_inflightOwner == nullptr || !closing(m_inflightHandle);
+  });
+}
+
+void VarnamTransliterator::cancelInflight() {
+  if (m_inflightOwner == nullptr || m_inflightCancelled) {
+    return;
+  }
+  m_inflightCancelled = true;
+  VarnamBackend::get()->cancel(m_inflightOperation);
+}
+
+int VarnamTransliterator::transliterate(int varnamHandle,
+                                        const std::string &input,
+                                        std::vector<std::string> &result,
+                                        VarnamSchemeStats *stats) {
+  return transliterate(VarnamLane::Interactive, varnamHandle,
+                       s_nextOperation++, input, result, stats);
+}
+
+int VarnamTransliterator::transliterate(VarnamLane lane, int varnamHandle,
+                                        int operation,
+                                        const std::string &input,
+                                        std::vector<std::string> &result,
+                                        VarnamSchemeStats *stats) {
+  VarnamStageTimer timer(stats, VarnamStage::Transliterate);
+  ++s_transliterations;
+  auto backend = VarnamBackend::get();
+  if (lane == VarnamLane::Background) {
+    return backend->transliterateBackground(varnamHandle, operation, input,
+                                            result);
+  }
+  return backend->transliterate(varnamHandle, operation, input, result);
+}
+
+void VarnamTransliterator::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_cond.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+    if (m_stop) {
+      break;
+    }
+    Job job = std::move(m_queue.front());
+    m_queue.pop_front();
+    m_inflightOwner = job.owner;
+    m_inflightHandle = job.varnamHandle;
+    m_inflightOperation = job.operation;
+    m_inflightCancelled = false;
+    lock.unlock();
+
+    std::vector<std::string> result;
+    int rv = transliterate(m_lane, job.varnamHandle, job.operation, job.input,
+                           result, job.stats);
+
+    lock.lock();
+    bool cancelled = m_inflightCancelled;
+    m_inflightOwner = nullptr;
+    m_inflightHandle = 0;
+    m_inflightOperation = 0;
+    m_inflightCancelled = false;
+    m_idleCond.notify_all();
+    if (cancelled || m_stop) {
+      continue;
+    }
+    if (rv != VARNAM_SUCCESS) {
+      VARNAM_WARN() << "varnam transliterate failed! err:" << rv;
+      continue;
+    }
+    std::weak_ptr<bool> alive = m_alive;
+    m_instance->eventDispatcher().schedule(
+        [alive, callback = std::move(job.callback), generation = job.generation,
+         input = std::move(job.input), result = std::move(result)]() mutable {
+          if (alive.expired()) {
+            return;
+          }
+          callback(generation, input, std::move(result));
+        });
+  }
+}
+
+} // namespace fcitx
@@ -0,0 +1,101 @@
+#ifndef _FCITX5_VARNAM_TRANSLITERATOR_H_
+#define _FCITX5_VARNAM_TRANSLITERATOR_H_
+
+#include "varnam_executor.h"
+#include "varnam_stats.h"
+
+#include <fcitx/instance.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fcitx {
+
+// Runs varnam_transliterate on a worker thread, one pending request per
+// owner. Results are delivered on the fcitx main thread through the
+// instance event dispatcher. Lookups of a background transliterator wait
+// for the interactive calls on the same handle.
+class VarnamTransliterator {
+public:
+  using Callback =
+      std::function<void(uint64_t generation, const std::string &input,
+                         std::vector<std::string> result)>;
+
+  VarnamTransliterator(Instance *instance,
+                       VarnamLane lane = VarnamLane::Interactive);
+
+  ~VarnamTransliterator();
+
+  // queue a transliteration, superseding the pending or in-flight request
+  // of the same owner
+  void submit(const void *owner, int varnamHandle, uint64_t generation,
+              std::string input, Callback callback,
+              VarnamSchemeStats *stats = nullptr);
+
+  // drop the pending request of owner and abort its in-flight lookup
+  void cancel(const void *owner);
+
+  // drop the requests on handles, abort the in-flight one if it is on one
+  // of them and wait until it has returned
+  void drain(const std::vector<int> &handles);
+
+  // transliterate on the calling thread
+  static int transliterate(int varnamHandle, const std::string &input,
+                           std::vector<std::string> &result,
+                           VarnamSchemeStats *stats = nullptr);
+
+  // number of varnam_transliterate calls made so far
+  static uint64_t transliterationCount() { return s_transliterations; }
+
+private:
+  struct Job {
+    const void *owner;
+    int varnamHandle;
+    int operation;
+    uint64_t generation;
+    std::string input;
+    Callback callback;
+    VarnamSchemeStats *stats;
+  };
+
+  Instance *m_instance;
+  VarnamLane m_lane;
+  std::shared_ptr<bool> m_alive;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::condition_variable m_idleCond;
+  std::deque<Job> m_queue;
+  const void *m_inflightOwner = nullptr;
+  int m_inflightHandle = 0;
+  int m_inflightOperation = 0;
+  bool m_inflightCancelled = false;
+  bool m_stop = false;
+  std::thread m_thread;
+
+  static std::atomic<int> s_nextOperation;
+  static std::atomic<uint64_t> s_transliterations;
+
+  static int transliterate(VarnamLane lane, int varnamHandle, int operation,
+                           const std::string &input,
+                           std::vector<std::string> &result,
+                           VarnamSchemeStats *stats);
+
+  // worker thread main loop
+  void run();
+
+  // cancel the in-flight lookup, expects m_mutex to be held
+  void cancelInflight();
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_TRANSLITERATOR_H_
@@ -1,4 +1,5 @@
 #include "varnam_utils.h"
+#include "varnam_backend.h"
 
 extern "C" {
 #include <libgovarnam/libgovarnam.h>
@@ -88,19 +89,17 @@ int getNumOfUTFCharUnits(char32_t code_point) {
 }
 
 void varnam_learn_word(int varnam_handle_id, const std::string &word_,
-                       int weight) {
-  char *word = const_cast<char *>(word_.c_str());
-  int rv = varnam_learn(varnam_handle_id, word, weight);
+                       int uses) {
+  int rv = VarnamBackend::get()->learnUses(varnam_handle_id, word_, uses);
   if (rv != VARNAM_SUCCESS) {
-    VARNAM_WARN() << "Failed to learn word:" << word;
+    VARNAM_WARN() << "Failed to learn word:" << word_;
   }
 }
 
 void varnam_unlearn_word(int varnam_handle_id, const std::string &word_) {
-  char *word = const_cast<char *>(word_.c_str());
-  int rv = varnam_unlearn(varnam_handle_id, word);
+  int rv = VarnamBackend::get()->unlearn(varnam_handle_id, word_);
   if (rv != VARNAM_SUCCESS) {
-    VARNAM_WARN() << "Failed to unlearn word:" << word;
+    VARNAM_WARN() << "Failed to unlearn word:" << word_;
   }
 }
 
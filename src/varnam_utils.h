@@ -42,11 +42,12 @@ const std::string getWordBreakChar(FcitxKeySym keyVal,
 // get the number of unicode character units in a code point
 int getNumOfUTFCharUnits(char32_t code_point);
 
-// varnam learn function, to run on a separate thread
+// varnam learn function, run by the learning worker, adds uses to the
+// weight of the word
 void varnam_learn_word(int varnam_handle_id, const std::string &word_,
-                       int weight);
+                       int uses);
 
-// varnam unlearn function, to run on a separate thread
+// varnam unlearn function, run by the learning worker
 void varnam_unlearn_word(int varnam_handle_id, const std::string &word_);
 
 // check the current key and states against a key list and return the index
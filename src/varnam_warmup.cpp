@@ -0,0 +1,131 @@
+#include "varnam_warmup.h"
+#include "varnam_backend.h"
+#include "varnam_cache.h"
+#include "varnam_transliterator.h"
+#include "varnam_utils.h"
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace fcitx {
+
+namespace {
+
+// short inputs most words start with, their lookups touch the common
+// paths of the scheme and the learnings
+constexpr const char *WarmupInputs[] = {"a",  "ka", "ma", "na", "ra",
+                                        "la", "pa", "va", "sa", "tha"};
+
+constexpr size_t ReadChunkSize = 64 * 1024;
+
+} // namespace
+
+VarnamWarmup::VarnamWarmup(VarnamTransliterator *transliterator)
+    : m_transliterator(transliterator) {}
+
+VarnamWarmup::~VarnamWarmup() {
+  stop();
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+}
+
+void VarnamWarmup::start(const std::string &scheme, int varnamHandle,
+                         VarnamResultCache *cache, bool readahead) {
+  stop();
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+  ++m_stats.runs;
+  m_stop = false;
+  m_thread = std::thread(
+      [this, scheme, readahead]() {
+        touch(VarnamBackend::get()->schemeFiles(scheme), readahead);
+      });
+
+  ++m_round;
+  m_varnamHandle = varnamHandle;
+  m_cache = cache;
+  m_finished = false;
+  m_pending.clear();
+  for (const char *input : WarmupInputs) {
+    if (!cache || !cache->contains(input)) {
+      m_pending.emplace_back(input);
+    }
+  }
+  submitNext();
+}
+
+void VarnamWarmup::stop() {
+  if (m_stop.exchange(true)) {
+    return;
+  }
+  if (!m_pending.empty()) {
+    ++m_stats.stopped;
+  }
+  m_transliterator->cancel(this);
+  m_pending.clear();
+  m_cache = nullptr;
+  ++m_round;
+}
+
+VarnamWarmup::Stats VarnamWarmup::stats() const {
+  Stats stats = m_stats;
+  stats.bytesRead = m_bytesRead;
+  return stats;
+}
+
+void VarnamWarmup::touch(std::vector<std::string> files, bool readahead) {
+  // stay out of the way of everything else on the machine
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+  std::vector<char> buffer(ReadChunkSize);
+  for (const auto &file : files) {
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      continue;
+    }
+    if (readahead) {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    }
+    ssize_t bytes;
+    while (!m_stop && (bytes = read(fd, buffer.data(), buffer.size())) > 0) {
+      m_bytesRead += bytes;
+    }
+    close(fd);
+    if (m_stop) {
+      break;
+    }
+  }
+}
+
+void VarnamWarmup::submitNext() {
+  if (m_pending.empty()) {
+    return;
+  }
+  auto input = std::move(m_pending.back());
+  m_pending.pop_back();
+  ++m_stats.lookups;
+  auto cache = m_cache;
+  auto epoch = cache ? cache->epoch() : 0;
+  m_transliterator->submit(
+      this, m_varnamHandle, m_round, std::move(input),
+      [this, cache, epoch](uint64_t round, const std::string &input,
+                           std::vector<std::string> result) {
+        if (cache) {
+          cache->insert(input, result, epoch);
+        }
+        if (round != m_round) {
+          return;
+        }
+        if (m_pending.empty()) {
+          m_finished = true;
+          ++m_stats.completed;
+          return;
+        }
+        submitNext();
+      });
+}
+
+} // namespace fcitx
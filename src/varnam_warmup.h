@@ -0,0 +1,70 @@
+#ifndef _FCITX5_VARNAM_WARMUP_H_
+#define _FCITX5_VARNAM_WARMUP_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fcitx {
+
+class VarnamResultCache;
+class VarnamTransliterator;
+
+// Pulls the files of a freshly opened scheme into the page cache on a low
+// priority thread and runs a few common lookups through a background
+// transliterator, so the first real keys do not wait for the disk. Everything stops at the
+// first real key. Only used from the fcitx main thread.
+class VarnamWarmup {
+public:
+  struct Stats {
+    uint64_t runs;
+    uint64_t stopped;
+    uint64_t completed;
+    uint64_t bytesRead;
+    uint64_t lookups;
+  };
+
+  VarnamWarmup(VarnamTransliterator *transliterator);
+
+  ~VarnamWarmup();
+
+  // Warm up the files of scheme and the cache of varnamHandle, cache may
+  // be null to only warm up the engine. readahead additionally asks the
+  // kernel to prefetch the whole files. Stops the previous run.
+  void start(const std::string &scheme, int varnamHandle,
+             VarnamResultCache *cache, bool readahead);
+
+  // abort the running warm-up, called as soon as a real key arrives
+  void stop();
+
+  // whether the lookups of the last run, on varnamHandle, all completed
+  bool finished(int varnamHandle) const {
+    return m_finished && m_varnamHandle == varnamHandle;
+  }
+
+  Stats stats() const;
+
+private:
+  VarnamTransliterator *m_transliterator;
+  std::thread m_thread;
+  std::atomic<bool> m_stop{false};
+  std::atomic<uint64_t> m_bytesRead{0};
+  Stats m_stats{};
+
+  int m_varnamHandle = 0;
+  VarnamResultCache *m_cache = nullptr;
+  uint64_t m_round = 0;
+  std::vector<std::string> m_pending;
+  bool m_finished = false;
+
+  // read files with low priority until done or stopped
+  void touch(std::vector<std::string> files, bool readahead);
+
+  void submitNext();
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_VARNAM_WARMUP_H_
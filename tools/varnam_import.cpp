@@ -0,0 +1,112 @@
+// Learns the words of a UTF-8 corpus into the user's govarnam dictionary.
+//
+// usage: varnamfcitx-import [--scheme ID] [--workers N] [--max-words N]
+//          [--batch N] [--state PATH] [--restart] CORPUS
+//
+// Progress is saved to the state file (CORPUS.varnam-import by default),
+// running the same command again after an interruption continues from the
+// last checkpoint. --restart ignores the saved state.
+
+#include "varnam_importer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace {
+
+fcitx::VarnamCorpusImporter *runningImporter = nullptr;
+
+void interrupt(int) {
+  if (runningImporter) {
+    runningImporter->cancel();
+  }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  using namespace fcitx;
+
+  VarnamCorpusImporter::Options options;
+  options.scheme = "ml";
+  std::string corpus;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--scheme" && i + 1 < argc) {
+      options.scheme = argv[++i];
+    } else if (arg == "--workers" && i + 1 < argc) {
+      options.workers = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--max-words" && i + 1 < argc) {
+      options.maxWords = std::max(1L, std::atol(argv[++i]));
+    } else if (arg == "--batch" && i + 1 < argc) {
+      options.batchWords = std::max(1L, std::atol(argv[++i]));
+    } else if (arg == "--state" && i + 1 < argc) {
+      options.statePath = argv[++i];
+    } else if (arg == "--restart") {
+      options.resume = false;
+    } else if (corpus.empty() && arg[0] != '-') {
+      corpus = arg;
+    } else {
+      corpus.clear();
+      break;
+    }
+  }
+  if (corpus.empty()) {
+    std::cerr << "usage: " << argv[0]
+              << " [--scheme ID] [--workers N] [--max-words N] [--batch N]"
+                 " [--state PATH] [--restart] CORPUS"
+              << std::endl;
+    return 1;
+  }
+  options.corpus = corpus;
+  if (options.statePath.empty()) {
+    options.statePath = corpus + ".varnam-import";
+  }
+
+  VarnamCorpusImporter importer(options);
+  runningImporter = &importer;
+  std::signal(SIGINT, interrupt);
+  std::signal(SIGTERM, interrupt);
+
+  auto lastReport = std::chrono::steady_clock::time_point();
+  auto print = [](const VarnamCorpusImporter::Progress &progress) {
+    double megabytes = progress.bytesRead / 1048576.0;
+    double seconds = std::max(progress.seconds, 0.001);
+    std::fprintf(stderr,
+                 "\r%5.1f%% %.1f MiB %.1f MiB/s words=%llu learned=%llu "
+                 "failed=%llu",
+                 progress.totalBytes ? 100.0 * progress.bytesRead /
+                                           progress.totalBytes
+                                     : 100.0,
+                 megabytes, megabytes / seconds,
+                 static_cast<unsigned long long>(progress.words),
+                 static_cast<unsigned long long>(progress.learned),
+                 static_cast<unsigned long long>(progress.failed));
+  };
+  VarnamCorpusImporter::Progress last{};
+  bool ok = importer.run([&](const VarnamCorpusImporter::Progress &progress) {
+    last = progress;
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastReport >= std::chrono::seconds(1)) {
+      lastReport = now;
+      print(progress);
+    }
+  });
+  runningImporter = nullptr;
+  if (!ok) {
+    std::cerr << importer.error() << std::endl;
+    return 1;
+  }
+  print(last);
+  std::cerr << std::endl;
+  if (importer.cancelled()) {
+    std::cerr << "interrupted, run again to continue" << std::endl;
+    return 130;
+  }
+  return 0;
+}